@@ -57,10 +57,27 @@ typedef COMPOST_STRUCT type {
 	compost_obj dynamic_fields;
 	compost_obj static_fields;
 	compost_obj page_list;
+	compost_obj runtime;
 	compost_obj client_data; // this is customizable
 	uint8_t flags;
 } compost_type_t;
 
+// set before compost_setup() to carve all pages from one reserved range
+extern size_t compost_heap_reserve;
+
+// outside of that range, pages are carved from chunks of this size (in bytes)
+extern size_t compost_chunk_bytes;
+
+// set before compost_setup() to use pages of this size (a power of two
+// multiple of the system page size) instead of the system ones
+extern size_t compost_page_size;
+
+// set before compost_setup() to back pages with transparent huge pages
+extern bool compost_huge_pages;
+
+// arrays bigger than this (in bytes) get a mapping of their own
+extern size_t compost_large_array_bytes;
+
 typedef struct {
 	compost_type_t * rt;
 	compost_type_t * szt;
@@ -78,6 +95,14 @@ extern void compost_for_each_type(compost_type_t * root_type, compost_for_each_t
 // page.h
 extern size_t compost_pages;
 
+// empty pages stay mapped (their memory discarded) to be reused: each type
+// keeps up to compost_retain_type_pages, the others go to a global pool which
+// is trimmed down to compost_retain_low once it holds more than compost_retain_pages
+extern size_t compost_retain_type_pages;
+extern size_t compost_retain_pages;
+extern size_t compost_retain_low;
+extern size_t compost_retained_pages;
+
 typedef COMPOST_STRUCT compost_array_obj {
 	void * rsv[2];
 	compost_obj content_type;
@@ -86,16 +111,34 @@ typedef COMPOST_STRUCT compost_array_obj {
 
 extern compost_obj compost_spot(compost_type_t * type);
 
+extern void compost_spot_n(compost_type_t * type, size_t n, compost_obj * out);
+
 extern void * compost_spot_dependent(void * destination, compost_type_t * type);
 
 extern compost_obj compost_spot_array(compost_type_t * type, size_t size);
 
 extern void * compost_spot_array_dependent(void * destination, compost_type_t * type, size_t size);
 
+extern compost_obj compost_array_resize(compost_obj array, size_t capacity);
+
 void * compost_array_get(compost_obj array, size_t index);
 
 size_t compost_array_find(compost_obj array, compost_obj item);
 
+extern void compost_flush_magazines();
+
+// moves the instances of the pages less than target_occupancy percent full into
+// denser ones; the program must only hold pointers to protected objects of the type
+extern size_t compost_compact(compost_type_t * type, size_t target_occupancy);
+
+// how many pages a type maps at once when it runs out of slots: always pages,
+// or from one page up to pages, doubling at each run (adaptive: halving when
+// the collector empties pages of the type)
+#define COMPOST_GROWTH_FIXED     0
+#define COMPOST_GROWTH_GEOMETRIC 1
+#define COMPOST_GROWTH_ADAPTIVE  2
+extern void compost_set_growth(compost_type_t * type, uint8_t policy, size_t pages);
+
 // field.h
 
 typedef struct compost_constraint {
@@ -107,6 +150,7 @@ typedef struct compost_constraint {
 #define COMPOST_FIELD_POINTER    0b0000001
 #define COMPOST_FIELD_AUTO_INST  0b0000010
 #define COMPOST_FIELD_DEPENDENT  0b0000101
+#define COMPOST_FIELD_BACK_LINK  0b0010000 // with COMPOST_FIELD_REFERENCES: O(1) clearing, one more referencer slot
 #define COMPOST_FIELD_MALLOC     0b0100000
 #define COMPOST_FIELD_REFERENCES 0b1000001
 
@@ -122,6 +166,8 @@ extern void * compost_get_c_object(compost_obj obj);
 
 extern compost_obj compost_prepare(compost_obj obj, compost_type_t * type);
 
+extern void compost_prepare_n(compost_obj * objs, size_t n, compost_type_t * type);
+
 extern void * compost_detach_dependent(void * field);
 
 extern void * compost_attach_dependent(void * destination, void * dependent);
@@ -142,6 +188,10 @@ extern compost_obj compost_get_field(compost_obj obj, size_t length, char * name
 
 
 // refc.h
+
+// threads marking and sweeping in compost_garbage_collect (1 by default)
+extern size_t compost_gc_threads;
+
 extern compost_obj compost_get_final_obj(compost_obj address);
 
 extern size_t compost_get_refc(compost_obj address);
@@ -156,6 +206,21 @@ extern void compost_remove_superfluous_pages(compost_type_t * type);
 
 extern void compost_garbage_collect(compost_type_t * root_type);
 
+// only collects the objects spotted since the last collection
+extern void compost_minor_collect(compost_type_t * root_type);
+
+// runs a slice of an incremental collection; true once it is over
+extern bool compost_gc_step(compost_type_t * root_type, size_t budget);
+
+// a background collector stops the world for each slice: they only run while no thread is between enter and leave
+extern bool compost_start_collector(compost_type_t * root_type, size_t budget, size_t pause_us);
+
+extern void compost_stop_collector();
+
+extern void compost_mutator_enter();
+
+extern void compost_mutator_leave();
+
 // dict.h
 
 typedef COMPOST_STRUCT compost_dict {
@@ -175,6 +240,12 @@ extern size_t compost_dict_count(compost_obj d_refc);
 
 extern void compost_get_next_index(compost_obj dictionnary, compost_array * index);
 
+// descriptor.h
+extern void compost_desc_cache_stats(size_t * hits, size_t * misses);
+
+// register pages of the descriptor tree in use
+extern size_t compost_registers;
+
 // debug.h
 extern void compost_print_regs();
 
@@ -37,27 +37,123 @@ size_t reg_md_bits;
 size_t reg_part_bits;
 size_t reg_last_part_bits;
 
+// flat heap mode (disabled while compost_heap_reserve is 0)
+size_t compost_heap_reserve;
+ptr_t heap_base;
+size_t heap_size;
+page_desc_t ** heap_table;
+
+// outside of the reserved heap, pages are carved from chunks of
+// compost_chunk_bytes, mapped one at a time; pages given back are
+// discarded and reused, and a chunk is unmapped once all its pages are
+// given back
+#define CHUNK_BYTES (4 << 20)
+
+// with compost_huge_pages, chunks, the reserved heap and large private
+// mappings are aligned on HUGE_PAGE_BYTES and advised to be backed by
+// transparent huge pages
+#define HUGE_PAGE_BYTES (2 << 20)
+
+typedef struct chunk chunk_t;
+typedef struct chunk {
+	chunk_t * next;
+	ptr_t base;
+	size_t pages;
+	size_t brk;        // pages carved so far
+	size_t free_pages; // pages given back, below brk
+	uint64_t free[];   // one bit per page given back
+} chunk_t;
+
+size_t compost_chunk_bytes;
+bool compost_huge_pages;
+chunk_t * chunks; // the newest first
+size_t chunks_free_pages;
+chunk_t * heap_chunk; // the reserved heap, carved and given back the same way
+
+// registers are carved REG_SLAB_PAGES at a time; the ones left
+// empty when pages are unregistered are recycled
+#define REG_SLAB_PAGES 16
+
+ptr_t reg_slab_free; // recycled registers, linked through their first entry
+ptr_t reg_slab_next;
+size_t reg_slab_left;
+size_t compost_registers;
+
+// per-thread direct-mapped descriptor cache, in front of the registers
+#define DESC_CACHE_SIZE 64
+
+typedef struct desc_cache_entry {
+	size_t page;
+	page_desc_t * desc;
+} desc_cache_entry_t;
+
+__thread desc_cache_entry_t desc_cache[DESC_CACHE_SIZE];
+__thread size_t desc_cache_epoch;
+__thread size_t desc_cache_hits;
+__thread size_t desc_cache_misses;
+size_t desc_cache_generation;
+
 #define PAGE_BASIC     0b0000
 #define PAGE_DEPENDENT 0b0001
+#define PAGE_CLASS     0b0010 // array page split in segments of one size class
+#define PAGE_LARGE     0b0100 // private mapping holding a single array segment
 
 typedef struct page_desc {
 	ptr_t vartype;
 	ptr_t next;
 	ptr_t flags_and_limit;
+	ptr_t bitmap;      // end of the slots = start of the occupancy bitmap
+	ptr_t next_free;   // next page of the same type having free slots
+	size_t free_slots;
+	size_t stride;     // size of the slots (instances or array segments)
+	size_t fresh;      // slots from this index on were never used (still zeroed)
+	bool unswept;      // slots were released since the page was last swept
+	ptr_t marks;       // collector marks (malloc'd), see mark_slot
+	size_t mark_epoch; // collection the marks belong to
+	ptr_t next_young;  // next page of young_pages, see touch_page
+	size_t young;      // young_generation the page was listed in
 } page_desc_t;
 // USE MACRO FUNCTIONS IN PAGE.H TO ACCESS THESE FIELDS
 
 void compute_regs_config();
 
+void * map_aligned(size_t bytes, int prot, int flags);
+
+void advise_huge_pages(void * address, size_t bytes);
+
+void reserve_heap();
+
 ptr_t new_random_page(size_t contig_len);
 
+ptr_t new_chunk_pages(size_t contig_len);
+
+ptr_t new_private_pages(size_t contig_len);
+
+ptr_t remap_pages(void * address, size_t contig_len, size_t new_len);
+
+void release_pages(void * address, size_t contig_len);
+
+void discard_pages(void * address, size_t contig_len);
+
+ptr_t new_register();
+
+void free_register(ptr_t reg);
+
 ptr_t get_reg_metadata(ptr_t reg);
 
 void set_reg_metadata(ptr_t reg, ptr_t metadata);
 
 page_desc_t * get_page_descriptor(void * address);
 
-void set_page_descriptor(ptr_t address, page_desc_t * desc);
+void invalidate_desc_caches();
+
+void compost_desc_cache_stats(size_t * hits, size_t * misses);
+
+ptr_t * set_page_descriptor(ptr_t address, page_desc_t * desc);
+
+void set_page_descriptors(ptr_t address, size_t contig_len, page_desc_t * desc);
+
+void clear_page_descriptor(ptr_t address);
 
 void prepare_page_desc(page_desc_t * desc, vartype_t vartype, void * next, size_t contig_len, uint8_t flags);
 
@@ -34,11 +34,15 @@ typedef COMPOST_STRUCT field_info_b field_info_b_t;
 #define FIBF_AUTO_INST  0b00000010
 #define FIBF_DEPENDENT  0b00000101 // includes FIBF_POINTER
 #define FIBF_NESTED     0b00001000
-#define FIBF_ARRAY      -DONT- // 0b00010000
+#define FIBF_BACK_LINK  0b00010000 // with FIBF_REFERENCES: the field keeps the slot leading to it
 #define FIBF_MALLOC     0b00100000
 #define FIBF_REFERENCES 0b01000001 // includes FIBF_POINTER
 #define FIBF_PREV_OWNER 0b10000000
 
+// fields which lead to other objects, and fields which reset_fields handles
+#define TRACED_FIELD(flags) (((flags) & FIBF_DEPENDENT) == FIBF_DEPENDENT || ((flags) & FIBF_REFERENCES) == FIBF_REFERENCES)
+#define NEEDS_RESET_STEP(flags) (TRACED_FIELD(flags) || ((flags) & FIBF_MALLOC))
+
 typedef COMPOST_STRUCT field_info_a {
 	type_t * field_type;
 	size_t data_offset;
@@ -79,6 +83,10 @@ type_t * compost_type_of(void * obj);
 
 void * compost_get_c_object(void * obj);
 
+void zero(void * addr, size_t sz, char value);
+
+void compost_prepare_n(void ** objs, size_t n, type_t * type);
+
 void * compost_prepare(void * obj, type_t * type);
 
 void * detach_field(void * raw_refc, void * field);
@@ -89,16 +97,44 @@ void * compost_detach_dependent(void * field);
 
 void * compost_attach_dependent(void * destination, void * dependent);
 
+typedef struct relocation {
+	size_t old_start;
+	size_t size;
+	size_t delta; // wraps around when moving down
+} relocation_t;
+
+void ** find_dependent_field(void ** owner_refc, void * dependent);
+
+void relocate(void ** old_refc, void ** new_refc, size_t size);
+
 void ** get_previous_owner(void * ref_field);
 
+void *** get_back_link(void * ref_field);
+
+void link_referrer(void ** slot, void * ref_field);
+
+void unlink_referrer(void ** slot);
+
 void compost_set_reference(void * field, void * obj);
 
 void compost_clear_reference(void * field);
 
 void check_references(void ** refc, recursive_call_t * rec);
 
+void build_reset_plan(type_t * type, type_runtime_t * runtime);
+
+type_runtime_t * get_reset_plan(type_t * type);
+
+void reset_field(void * c_object, void * field, uint8_t flags);
+
 void reset_fields(void * c_object, type_t * type);
 
+void trace_fields(void * c_object, type_t * type, mark_stack_t * stack);
+
+void unlink_field(void * c_object, void * field, uint8_t flags);
+
+void unlink_fields(void * c_object, type_t * type);
+
 void * compost_create_type(void * any_paged_obj, size_t nested_objects, size_t referencers, size_t object_size, uint8_t flags);
 
 size_t compost_set_dynamic_field(type_t * host_type, vartype_t field_vartype, array field_name, size_t fib_offset, uint8_t flags);
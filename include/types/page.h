@@ -22,18 +22,29 @@
 
 #include <sys/mman.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "type.h"
 
 typedef COMPOST_STRUCT root_page root_page_t;
+typedef struct type_runtime type_runtime_t;
 
 #include "refc.h"
 #include "field.h"
 #include "descriptor.h"
 
-size_t page_size;
+size_t page_size; // the Compost page unit, a power of two multiple of system_page_size
 size_t page_rel_mask;
 size_t page_mask;
+size_t system_page_size;
+size_t compost_page_size; // set before compost_setup to change the page unit
 size_t compost_pages;
+page_desc_t * empty_pages;
+pthread_mutex_t pages_lock; // page mapping, registers, compost_pages & the retained pages
+size_t compost_large_array_bytes;
+size_t collection_epoch; // bumped by each collection, making older marks stale
+page_desc_t * young_pages; // pages where objects were spotted or fields set since the last collection
+size_t young_generation;   // bumped when young_pages is emptied
+pthread_mutex_t young_lock;
 
 #define ARRAY_GET(obj, item_size, i) ((void *)((array_obj_t *)(obj) + 1) + (item_size) * (i))
 
@@ -42,10 +53,137 @@ size_t compost_pages;
 #define PG_NEXT(desc)  ((page_desc_t *)((desc)->next.p))
 #define PG_FLAGS(desc) ((desc)->flags_and_limit.s & page_rel_mask)
 #define PG_RAW_LIMIT(desc) ((desc)->flags_and_limit.s & page_mask)
-#define PG_LIMIT(desc, type) (PG_RAW_LIMIT(desc) - (type)->paged_size + 1)
+#define PG_LIMIT(desc, type) ((desc)->bitmap.s - (type)->paged_size + 1)
+#define PG_HAS_SLOTS(desc) ((desc)->bitmap.s != PG_RAW_LIMIT(desc))
+#define PG_BITMAP(desc) ((uint64_t *)((desc)->bitmap.p))
+#define PG_SLOTS(desc) (((desc)->bitmap.s - PP(PG_REFC2(desc)).s) / (desc)->stride)
+#define PG_SLOT_INDEX(desc, refc) ((PP(refc).s - PP(PG_REFC2(desc)).s) / (desc)->stride)
+#define PG_SLOT(desc, i) ((void *)PG_REFC2(desc) + (i) * (desc)->stride)
+#define PG_FREE_LIST(flags) ((flags) & PAGE_DEPENDENT)
+
+// arrays up to page_size / ARRAY_CLASS_MIN_SEGMENTS bytes (header included) are
+// spotted in pages of fixed size segments, one size class per power of two
+#define ARRAY_MIN_CLASS 64
+#define ARRAY_CLASSES   8
+#define ARRAY_CLASS_MIN_SEGMENTS 4
+#define ARRAY_CLASS_SIZE(c) ((size_t)ARRAY_MIN_CLASS << (c))
+
+// arrays bigger than compost_large_array_bytes (descriptor included) get a
+// private mapping, grown with mremap; this is its default, in pages
+#define ARRAY_LARGE_PAGES 64
+
+// empty pages are kept mapped and registered (but discarded) for reuse:
+// each type keeps compost_retain_type_pages of them, and the others go to
+// a global pool, trimmed down to compost_retain_low once it holds more
+// than compost_retain_pages
+#define RETAIN_TYPE_PAGES 4
+#define RETAIN_PAGES      64
+#define RETAIN_LOW        16
+
+// pages of a type are carved by clusters of CLUSTER_PAGES, so that they
+// stay next to each other when several types grow at the same time
+#define CLUSTER_PAGES 8
+
+// how many pages a type maps when it runs out of slots: always the same
+// count (1 by default), twice as many as the previous time, or twice as
+// many unless the collector emptied pages of the type since, in which
+// case half as many. The count is capped by growth_pages.
+#define GROWTH_FIXED     0
+#define GROWTH_GEOMETRIC 1
+#define GROWTH_ADAPTIVE  2
+
+typedef struct retained_page retained_page_t;
+typedef struct retained_page {
+	retained_page_t * next;
+	void * page;
+	size_t contig_len;
+} retained_page_t;
+
+size_t compost_retain_type_pages;
+size_t compost_retain_pages;
+size_t compost_retain_low;
+size_t compost_retained_pages; // pages held by the global pool and the types
+retained_page_t * retained_pages;
+size_t retained_global; // pages of retained_pages
+
+// fields which reset_fields handles one by one; types having more
+// of them than RESET_PLAN_SIZE are reset byte per byte
+#define RESET_PLAN_SIZE 16
+
+typedef struct reset_step {
+	uint32_t offset;
+	uint8_t flags;
+} reset_step_t;
+
+typedef struct type_runtime {
+	pthread_mutex_t lock;        // free lists, bitmaps & page list of the type
+	page_desc_t * free_pages[2]; // basic & dependent pages having free slots
+	page_desc_t * class_pages[ARRAY_CLASSES][2]; // same, for array segments
+	bool dirty;   // an instance may have died since the type was last swept
+	bool collect; // the current collection prunes and sweeps the type
+	bool in_arrays; // the type was used as the item type of arrays
+	bool reset_plan_ready;
+	retained_page_t * retained; // empty pages kept for the type
+	size_t retained_count;
+	ptr_t cluster; // pages carved for the type, not mapped yet
+	size_t cluster_left;
+	uint8_t growth;      // GROWTH_*, see compost_set_growth
+	size_t growth_pages; // count of pages, or the cap
+	size_t growth_next;  // pages of the next run, when growing
+	size_t reset_steps;
+	reset_step_t reset_plan[RESET_PLAN_SIZE];
+} type_runtime_t;
+
+// tags the slots which claim_slots hands out above the high-water mark
+// of their page: they were never used, so they need no reset. Slots are
+// not aligned, so the tag is the top bit, never set in user addresses.
+#define FRESH_SLOT ((size_t)1 << (PTR_BITS - 1))
+#define UNTAG_SLOT(slot) ((void **)(PP(slot).s & ~(size_t)FRESH_SLOT))
+
+// per-thread caches of claimed but unused slots, refilled in batches
+#define MAGAZINES      16
+#define MAGAZINE_SIZE  32
+#define MAGAZINE_BATCH 16
+
+typedef struct magazine {
+	type_t * type;
+	uint8_t flags;
+	size_t generation;
+	size_t count;
+	void * slots[MAGAZINE_SIZE];
+} magazine_t;
+
+__thread magazine_t magazines[MAGAZINES];
+size_t magazine_generation;
+
+void set_page_unit(size_t unit);
+
+void setup_page_unit();
+
+type_runtime_t * get_runtime(type_t * type);
+void release_cluster(type_runtime_t * runtime);
+void free_runtime(type_t * type);
+
+void prepare_page_slots(page_desc_t * desc, size_t stride);
+
+void claim_used_slots(page_desc_t * desc);
+
+void release_slot(void * raw_refc);
+
+void free_slot(void * raw_refc);
+
+void compost_flush_magazines();
+
+void invalidate_magazines();
+
+void rebuild_free_pages(type_t * type);
+
+void compost_set_growth(type_t * type, uint8_t policy, size_t pages);
 
 void * compost_spot(vartype_t vartype);
 
+void compost_spot_n(vartype_t vartype, size_t n, void ** out);
+
 void * compost_spot_dependent(void * destination, vartype_t vartype);
 
 void * compost_spot_array(type_t * type, size_t size);
@@ -54,15 +192,66 @@ void * compost_spot_array_dependent(void * destination, type_t * type, size_t si
 
 void shrink_array(page_desc_t * desc, array_obj_t * array_obj, size_t array_bytes);
 
+array_obj_t * class_segment(page_desc_t * desc, void * address);
+
+void reset_array(array_obj_t * array_obj);
+
 void grow_array(page_desc_t * desc, array_obj_t * array_obj);
 
+void * compost_array_resize(array_obj_t * array_obj, size_t capacity);
+
 void * compost_array_get(array_obj_t * array_obj, size_t index);
 
 size_t compost_array_find(array_obj_t * array_obj, void * item);
 
+void * next_slot(type_t * type, void * raw_refc);
+
+uint64_t * prepare_marks(page_desc_t * desc);
+
+bool mark_slot(void * raw_refc);
+
+bool is_slot_marked(void * raw_refc);
+
+bool is_slot_alive(void ** raw_refc);
+
+void unmark_slot(void * raw_refc);
+
+void touch_page(page_desc_t * desc);
+
+void dirty_type(type_t * type);
+
+void forget_young_pages();
+
+void unlink_dead_page(page_desc_t * desc, type_t * type);
+
+void prune_referrers(void ** refc);
+
+size_t prune_page(page_desc_t * desc, type_t * type);
+
+void prune_page_list(page_desc_t * desc, type_t * type);
+
+void sweep_fields(void * c_object, type_t * type, bool marked);
+
+void sweep_array(array_obj_t * array_obj);
+
 size_t page_occupied_slots(size_t pg_limit, uint8_t flags, void * first_instance, type_t * type);
 
-page_desc_t * update_page_list(page_desc_t * desc, type_t * type, bool should_delete);
+size_t sweep_page(page_desc_t * desc, type_t * type, mark_stack_t * deferred);
+void release_swept_slots(page_desc_t * desc, type_t * type, size_t slots, mark_stack_t * deferred);
+
+page_desc_t * update_page_list(page_desc_t * desc, type_t * type, bool should_delete, mark_stack_t * deferred);
+
+void queue_empty_page(page_desc_t * desc);
+
+void sweep_deferred(void ** raw_refc);
+
+void retain_page(page_desc_t * desc, size_t contig_len);
+
+void trim_retained_pages(size_t low);
+
+void release_empty_pages();
+
+size_t compost_compact(type_t * type, size_t target_occupancy);
 
 root_page_t * get_root_page(void * obj);
 
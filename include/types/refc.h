@@ -30,8 +30,48 @@ typedef struct recursive_call {
 	recursive_call_t * next;
 } recursive_call_t;
 
+// objects which the mark phase reached but did not trace yet
+typedef struct mark_stack {
+	void ** refcs;
+	size_t len;
+	size_t cap;
+} mark_stack_t;
+
+#define MARK_STACK_MIN 256
+
+// a marking thread shares half of its stack when it holds more than this
+#define MARK_SHARE 64
+
 #include "page.h"
 
+size_t compost_gc_threads; // threads marking and sweeping in a collection
+
+typedef struct gc gc_t;
+
+typedef struct gc_worker {
+	pthread_t thread;
+	pthread_mutex_t lock; // shared
+	mark_stack_t stack;   // objects to trace, then deferred resets
+	mark_stack_t shared;  // objects which idle workers may steal
+	gc_t * gc;
+} gc_worker_t;
+
+// state of a collection, shared by its workers
+typedef struct gc {
+	type_t * root_type;
+	type_t ** types;
+	size_t n_types;
+	size_t next_root;  // next type to scan for roots,
+	size_t next_prune; // to prune
+	size_t next_sweep; // and to sweep
+	size_t idle;       // workers having nothing to trace
+	size_t n_workers;
+	gc_worker_t * workers;
+	pthread_mutex_t start_lock;
+	pthread_barrier_t barrier;
+	bool sweep;
+} gc_t;
+
 // a direct self-reference is used as fake dependence
 #define FAKE_DEPENDENT(any_paged_obj) (any_paged_obj)
 
@@ -49,10 +89,70 @@ bool is_obj_protected(void * obj);
 
 void compost_unprotect(void * obj);
 
+// phases of an incremental collection
+#define GC_IDLE  0
+#define GC_ROOTS 1
+#define GC_MARK  2
+#define GC_PRUNE 3
+#define GC_SWEEP 4
+
+// where an incremental collection resumes
+typedef struct gc_cursor {
+	uint8_t phase;
+	type_t * root_type;
+	type_t ** types;      // the root type comes last
+	size_t n_types;
+	size_t type;          // index of the type being visited
+	page_desc_t ** link;  // link to the page being visited
+	bool detached;        // pages of the type were detached since its free lists were rebuilt
+	mark_stack_t stack;
+} gc_cursor_t;
+
+gc_cursor_t gc_cursor;
+pthread_mutex_t gc_barrier_lock; // mark stack of the cursor, for the barriers
+
+// background thread running compost_gc_step
+typedef struct collector {
+	pthread_t thread;
+	bool running;
+	type_t * root_type;
+	size_t budget;   // slots per slice
+	size_t pause_us; // between two collections
+} collector_t;
+
+collector_t gc_collector;
+
+// context of the last complete collection, whose marks tell the
+// old objects apart in compost_minor_collect; NULL when they are stale
+root_page_t * young_context;
+pthread_rwlock_t gc_world_lock; // read by the mutators, written by the slices of the collector
+
+void push_stack(mark_stack_t * stack, void ** raw_refc);
+
+void push_mark(mark_stack_t * stack, void ** raw_refc);
+
 int compost_type_instances(type_t * type);
 
+void gc_barrier(void ** raw_refc);
+
+void gc_barrier_relocate(void ** old_refc, void ** new_refc);
+
+void abandon_gc_step();
+
+bool compost_gc_step(type_t * root_type, size_t budget);
+
+void compost_mutator_enter();
+
+void compost_mutator_leave();
+
+bool compost_start_collector(type_t * root_type, size_t budget, size_t pause_us);
+
+void compost_stop_collector();
+
 void compost_remove_superfluous_pages(type_t * type, bool should_delete);
 
 void compost_garbage_collect(type_t * root_type);
 
+void compost_minor_collect(type_t * root_type);
+
 #endif
\ No newline at end of file
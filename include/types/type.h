@@ -47,6 +47,7 @@ typedef union ptr {
 #define PTR_BITS (sizeof(void *) * 8)
 
 #define CEILDIV(a, b) ((a / b) + ((a % b) != 0))
+#define ALIGN_UP(a, b) (CEILDIV((a), (b)) * (b))
 
 #define TYPE_BASIC     0b00000000
 #define TYPE_PRIMITIVE 0b00000001
@@ -66,10 +67,11 @@ typedef COMPOST_STRUCT type {
 	size_t object_size;     // 
 	size_t offsets;         // 
 	size_t paged_size;      // 
-	void * variants; // how many pages to allocate at once - not used yet
+	void * variants; // constraint arrays, see compost_create_type_variant
 	void * dynamic_fields;  // name -> field_info_*
 	void * static_fields;   // name -> *
 	void * page_list;       // 
+	void * runtime;         // allocation state, malloc'd (see page.h)
 	void * client_data;     // 
 	uint8_t flags;          // 
 } type_t;
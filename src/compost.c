@@ -17,6 +17,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#define _GNU_SOURCE // mremap
+
 #include "types/debug.c"
 #include "types/dict.c"
 #include "types/field.c"
@@ -154,7 +154,11 @@ int main(int argc, char *argv[]){
 			printf("new TYPE VARIABLE    create a new instance of a type\n");
 			printf("type NEW_TYPE        create a new type\n");
 		} else if (CMD("pages")){
-			printf("%lu pages\n", compost_pages);
+			size_t hits, misses;
+			compost_desc_cache_stats(&hits, &misses);
+			printf("%lu pages, %lu retained\n", compost_pages, compost_retained_pages);
+			printf("descriptor cache: %lu hits, %lu misses\n", hits, misses);
+			printf("%lu registers\n", compost_registers);
 			compost_print_regs();
 		} else if (!CMD("")) printf("Unknown command: \"%s\".\n", cmd);
 		free(cmd);
@@ -66,6 +66,7 @@ void load_fields(uint8_t flags){
 	else field_flags_str[i] = '-';
 	i++;
 	/**/ if (IS_(flags, FIBF_NESTED    )) field_flags_str[i] = 'N';
+	else if (IS_(flags, FIBF_BACK_LINK )) field_flags_str[i] = 'B';
 	else field_flags_str[i] = '-';
 	i++;
 	/**/ if (IS_(flags, FIBF_MALLOC    )) field_flags_str[i] = 'M';
@@ -234,6 +235,7 @@ void compost_show_pages(void * any_paged_address){
 				size_t instances = page_occupied_slots(PG_LIMIT(page, pgtype), PG_FLAGS(page), PG_REFC2(page), type);
 				if (pgtype != type) printf("Error with the following page type:\n");
 				printf("%p :\n\tflags: %hhx\n\tinstances: %lu\n", page, PG_FLAGS(page), instances);
+				if (PG_HAS_SLOTS(page)) printf("\tfree slots: %lu\n", page->free_slots);
 				page = PG_NEXT(page);
 			}
 
@@ -34,6 +34,28 @@ size_t reg_last_part_bits;
 
 ptr_t first_pgd_page = PP(NULL);
 
+size_t compost_chunk_bytes = CHUNK_BYTES;
+bool compost_huge_pages = false;
+chunk_t * chunks = NULL;
+size_t chunks_free_pages = 0;
+chunk_t * heap_chunk = NULL;
+
+ptr_t reg_slab_free = { NULL };
+ptr_t reg_slab_next = { NULL };
+size_t reg_slab_left = 0;
+size_t compost_registers = 0;
+
+size_t compost_heap_reserve = 0;
+ptr_t heap_base = { NULL };
+size_t heap_size = 0;
+page_desc_t ** heap_table = NULL;
+
+__thread desc_cache_entry_t desc_cache[DESC_CACHE_SIZE];
+__thread size_t desc_cache_epoch = 0;
+__thread size_t desc_cache_hits = 0;
+__thread size_t desc_cache_misses = 0;
+size_t desc_cache_generation = 0;
+
 // called by the constructor in page.c
 void compute_regs_config(){
 	for (page_relative_bits = 0; page_rel_mask >> page_relative_bits; page_relative_bits++);
@@ -49,12 +71,299 @@ void compute_regs_config(){
 	reg_md_bits = page_relative_bits - reg_i_bits;
 	reg_i_mask = (1 << reg_i_bits) - 1;
 	reg_md_mask = (1 << reg_md_bits) - 1;
-	first_reg.s = (new_random_page(1).s);
+	first_reg.s = (new_register().s);
 	first_reg.s |= page_relative_bits;
 }
 
+/* map_aligned (64bit bytes, 32bit prot, 32bit flags)
+ *
+ * Maps memory aligned on page_size, which may be larger than the
+ * system page size: a larger range is mapped, then trimmed. With
+ * compost_huge_pages, mappings of HUGE_PAGE_BYTES or more are aligned
+ * on it instead, and advised to be backed by huge pages.
+ * Return value: the mapping, or MAP_FAILED
+ */
+void * map_aligned(size_t bytes, int prot, int flags){
+	size_t align = page_size;
+	bool huge = compost_huge_pages && bytes >= HUGE_PAGE_BYTES;
+	if (huge && align < HUGE_PAGE_BYTES) align = HUGE_PAGE_BYTES;
+	ptr_t base;
+	if (align == system_page_size) base = PP(mmap(NULL, bytes, prot, flags, -1, 0));
+	else {
+		ptr_t raw = PP(mmap(NULL, bytes + align, prot, flags, -1, 0));
+		if (raw.p == MAP_FAILED) return MAP_FAILED;
+		base = SP((raw.s + align - 1) & ~(align - 1));
+		if (base.s > raw.s) munmap(raw.p, base.s - raw.s);
+		munmap(SP(base.s + bytes).p, raw.s + align - base.s);
+	}
+	if (huge && base.p != MAP_FAILED) advise_huge_pages(base.p, bytes);
+	return base.p;
+}
+
+/* advise_huge_pages (pointer address, 64bit bytes)
+ *
+ * Asks the system to back a range with transparent huge pages, when
+ * compost_huge_pages is set and the system supports it.
+ * Return value: none
+ */
+void advise_huge_pages(void * address, size_t bytes){
+#ifdef MADV_HUGEPAGE
+	if (compost_huge_pages) madvise(address, bytes, MADV_HUGEPAGE);
+#endif
+}
+
+/* reserve_heap ()
+ * note: called by compost_setup, only if compost_heap_reserve is not 0
+ *
+ * Reserves compost_heap_reserve bytes of address space (PROT_NONE) from
+ * which new pages are carved, and a flat table holding one descriptor
+ * per page of this range. Descriptors of pages in the range are then found
+ * with one subtraction, one shift and one load instead of a register walk.
+ * Return value: none
+ */
+void reserve_heap(){
+	size_t pages = compost_heap_reserve / page_size;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	void * base = map_aligned(pages * page_size, PROT_NONE, flags);
+	void * table = mmap(NULL, pages * sizeof(page_desc_t *), PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (base == MAP_FAILED || table == MAP_FAILED){
+		printf("Compost: could not reserve the heap, using the registers only.\n");
+		if (base != MAP_FAILED) munmap(base, pages * page_size);
+		if (table != MAP_FAILED) munmap(table, pages * sizeof(page_desc_t *));
+		return;
+	}
+	heap_table = table;
+	heap_base = PP(base);
+	heap_size = pages * page_size;
+	heap_chunk = calloc(1, sizeof(chunk_t) + CEILDIV(pages, 64) * sizeof(uint64_t));
+	*heap_chunk = (chunk_t){ NULL, heap_base, pages, 0, 0 };
+}
+
+/* give_back_pages (private function)
+ *
+ * Marks pages of a chunk (or of the reserved heap) as given back, for
+ * take_free_pages to hand them out again.
+ * Return value: none
+ */
+void give_back_pages(chunk_t * chunk, void * address, size_t contig_len){
+	size_t first = (PP(address).s - chunk->base.s) / page_size;
+	for (size_t j = first; j < first + contig_len; j++) chunk->free[j / 64] |= (uint64_t)1 << (j % 64);
+	chunk->free_pages += contig_len;
+}
+
+/* take_free_pages (private function)
+ *
+ * Finds contig_len pages in a row among the pages given back to a
+ * chunk (or to the reserved heap), and takes them.
+ * Return value: the first page, or NULL if there is no such run
+ */
+ptr_t take_free_pages(chunk_t * chunk, size_t contig_len){
+	size_t run = 0;
+	for (size_t i = 0; i < chunk->brk; i++){
+		if ((i % 64) == 0 && run == 0 && chunk->free[i / 64] == 0){
+			i += 63;
+			continue;
+		}
+		if (!((chunk->free[i / 64] >> (i % 64)) & 1)){
+			run = 0;
+			continue;
+		}
+		if (++run < contig_len) continue;
+		size_t first = i + 1 - contig_len;
+		for (size_t j = first; j <= i; j++) chunk->free[j / 64] &= ~((uint64_t)1 << (j % 64));
+		chunk->free_pages -= contig_len;
+		return SP(chunk->base.s + first * page_size);
+	}
+	return PP(NULL);
+}
+
 ptr_t new_random_page(size_t contig_len){
-	return PP(mmap(NULL, page_size * contig_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	size_t bytes = page_size * contig_len;
+	if (heap_size){
+		// pages given back first, so that churn does not exhaust the heap
+		ptr_t page = (heap_chunk->free_pages >= contig_len) ? take_free_pages(heap_chunk, contig_len) : PP(NULL);
+		if (page.p == NULL && heap_chunk->brk + contig_len <= heap_chunk->pages){
+			page = SP(heap_base.s + heap_chunk->brk * page_size);
+			heap_chunk->brk += contig_len;
+		}
+		if (page.p != NULL){
+			if (mprotect(page.p, bytes, PROT_READ | PROT_WRITE) == 0){
+				// released pages were remapped, losing the advice
+				advise_huge_pages(page.p, bytes);
+				return page;
+			}
+			give_back_pages(heap_chunk, page.p, contig_len);
+		}
+	}
+	if (bytes <= compost_chunk_bytes / 2){
+		ptr_t page = new_chunk_pages(contig_len);
+		if (page.p != MAP_FAILED) return page;
+	}
+	return new_private_pages(contig_len);
+}
+
+/* new_chunk_pages (64bit contig_len)
+ * note: callers must hold pages_lock (or be alone, during setup)
+ *
+ * Carves contig_len pages in a row from the chunks: pages which were
+ * given back come first, then the unused end of the newest chunk; a
+ * new chunk is mapped when neither has room. Consecutive calls return
+ * neighbouring pages, which keeps the registers dense.
+ * Return value: the first page, or MAP_FAILED
+ */
+ptr_t new_chunk_pages(size_t contig_len){
+	if (chunks_free_pages >= contig_len){
+		for (chunk_t * chunk = chunks; chunk; chunk = chunk->next){
+			if (chunk->free_pages < contig_len) continue;
+			ptr_t page = take_free_pages(chunk, contig_len);
+			if (page.p == NULL) continue;
+			chunks_free_pages -= contig_len;
+			return page;
+		}
+	}
+	chunk_t * chunk = chunks;
+	if (chunk == NULL || chunk->brk + contig_len > chunk->pages){
+		size_t pages = compost_chunk_bytes / page_size;
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+		void * base = map_aligned(pages * page_size, PROT_READ | PROT_WRITE, flags);
+		if (base == MAP_FAILED) return PP(MAP_FAILED);
+		chunk = calloc(1, sizeof(chunk_t) + CEILDIV(pages, 64) * sizeof(uint64_t));
+		*chunk = (chunk_t){ chunks, PP(base), pages, 0, 0 };
+		chunks = chunk;
+	}
+	ptr_t page = SP(chunk->base.s + chunk->brk * page_size);
+	chunk->brk += contig_len;
+	return page;
+}
+
+/* release_chunk_pages (private function)
+ * note: callers must hold pages_lock
+ *
+ * Gives pages back to the chunk holding them: their memory is discarded
+ * and they are kept for new_chunk_pages, unless the whole chunk is now
+ * unused, in which case it is unmapped.
+ * Return value: false if no chunk holds the pages
+ */
+bool release_chunk_pages(void * address, size_t contig_len){
+	chunk_t ** link = &chunks;
+	while (*link != NULL && (PP(address).s - (*link)->base.s) >= (*link)->pages * page_size) link = &(*link)->next;
+	chunk_t * chunk = *link;
+	if (chunk == NULL) return false;
+	if (chunk->free_pages + contig_len == chunk->brk && chunk != chunks){
+		*link = chunk->next;
+		chunks_free_pages -= chunk->free_pages;
+		munmap(chunk->base.p, chunk->pages * page_size);
+		free(chunk);
+		return true;
+	}
+	madvise(address, page_size * contig_len, MADV_DONTNEED);
+	give_back_pages(chunk, address, contig_len);
+	chunks_free_pages += contig_len;
+	return true;
+}
+
+/* new_private_pages (64bit contig_len)
+ *
+ * Maps pages of their own, outside of the reserved heap; unlike heap
+ * pages, they can be resized or moved by remap_pages.
+ * Return value: the first page
+ */
+ptr_t new_private_pages(size_t contig_len){
+	return PP(map_aligned(page_size * contig_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS));
+}
+
+/* remap_pages (pointer address, 64bit contig_len, 64bit new_len)
+ * note: the pages must come from new_private_pages.
+ *
+ * Grows or shrinks a mapping, which the system may move elsewhere
+ * (without copying) if it cannot grow in place. When pages are larger
+ * than the system ones, the mapping is moved to an aligned range.
+ * Return value: the first page of the mapping, or MAP_FAILED
+ */
+ptr_t remap_pages(void * address, size_t contig_len, size_t new_len){
+	size_t bytes = page_size * contig_len, new_bytes = page_size * new_len;
+	ptr_t moved;
+	if (page_size == system_page_size) moved = PP(mremap(address, bytes, new_bytes, MREMAP_MAYMOVE));
+	else {
+		moved = PP(mremap(address, bytes, new_bytes, 0));
+		if (moved.p == MAP_FAILED){
+			void * to = map_aligned(new_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+			if (to != MAP_FAILED) moved = PP(mremap(address, bytes, new_bytes, MREMAP_MAYMOVE | MREMAP_FIXED, to));
+			if (to != MAP_FAILED && moved.p == MAP_FAILED) munmap(to, new_bytes);
+		}
+	}
+	if (moved.p != MAP_FAILED && new_bytes >= HUGE_PAGE_BYTES) advise_huge_pages(moved.p, new_bytes);
+	invalidate_desc_caches();
+	return moved;
+}
+
+/* release_pages (pointer address, 64bit contig_len)
+ *
+ * Gives pages obtained with new_random_page back to the system.
+ * Pages of the reserved heap are replaced by an inaccessible mapping,
+ * so that the reserved range cannot be taken by another mmap call, and
+ * kept for new_random_page to hand out again.
+ * Return value: none
+ */
+void release_pages(void * address, size_t contig_len){
+	size_t bytes = page_size * contig_len;
+	if ((PP(address).s - heap_base.s) < heap_size){
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED;
+		mmap(address, bytes, PROT_NONE, flags, -1, 0);
+		give_back_pages(heap_chunk, address, contig_len);
+	} else if (!release_chunk_pages(address, contig_len)) munmap(address, bytes);
+	for (size_t j = 0; j < contig_len; j++) clear_page_descriptor(SP(PP(address).s + j * page_size));
+}
+
+/* discard_pages (pointer address, 64bit contig_len)
+ *
+ * Gives the physical memory of pages back to the system, leaving them
+ * mapped and registered; they read as zeroes the next time they are
+ * touched, just like new pages.
+ * Return value: none
+ */
+void discard_pages(void * address, size_t contig_len){
+	madvise(address, page_size * contig_len, MADV_DONTNEED);
+}
+
+/* new_register ()
+ * note: callers must hold pages_lock (or be alone, during setup)
+ *
+ * Hands out a zeroed register page: a recycled one if any, otherwise
+ * the next page of the current slab, which is mapped REG_SLAB_PAGES
+ * pages at a time.
+ * Return value: the register page
+ */
+ptr_t new_register(){
+	ptr_t reg = reg_slab_free;
+	compost_registers++;
+	if (reg.p != NULL){
+		reg_slab_free = *reg.p;
+		reg.p->s = 0;
+		return reg;
+	}
+	if (reg_slab_left == 0){
+		reg_slab_next = new_private_pages(REG_SLAB_PAGES);
+		reg_slab_left = REG_SLAB_PAGES;
+	}
+	reg = reg_slab_next;
+	reg_slab_next.s += page_size;
+	reg_slab_left--;
+	return reg;
+}
+
+/* free_register (pointer reg)
+ * note: callers must hold pages_lock
+ *
+ * Zeroes a register which no entry leads to anymore and keeps it
+ * for new_register.
+ * Return value: none
+ */
+void free_register(ptr_t reg){
+	memset(reg.p, 0, page_size);
+	*reg.p = reg_slab_free;
+	reg_slab_free = reg;
+	compost_registers--;
 }
 
 /*
@@ -87,6 +396,22 @@ void set_reg_metadata(ptr_t reg, ptr_t metadata){
 }
 
 page_desc_t * get_page_descriptor_raw(void * address){
+	size_t heap_offset = PP(address).s - heap_base.s;
+	if (heap_offset < heap_size) return heap_table[heap_offset >> page_relative_bits];
+
+	size_t generation = __atomic_load_n(&desc_cache_generation, __ATOMIC_ACQUIRE);
+	if (desc_cache_epoch != generation){
+		for (size_t i = 0; i < DESC_CACHE_SIZE; i++) desc_cache[i].desc = NULL;
+		desc_cache_epoch = generation;
+	}
+	size_t page = PP(address).s & page_mask;
+	desc_cache_entry_t * entry = &desc_cache[(page >> page_relative_bits) & (DESC_CACHE_SIZE - 1)];
+	if (entry->desc != NULL && entry->page == page){
+		desc_cache_hits++;
+		return entry->desc;
+	}
+	desc_cache_misses++;
+
 	ptr_t reg = SP(first_reg.s & page_mask);
 	size_t i = first_reg.s & reg_i_mask;
 	while (reg.p != NULL){
@@ -95,7 +420,9 @@ page_desc_t * get_page_descriptor_raw(void * address){
 		i = reg.s & reg_i_mask;
 		reg.s &= page_mask;
 	}
-	return (page_desc_t *)(reg.s & page_mask);
+	entry->page = page;
+	entry->desc = (page_desc_t *)(reg.s & page_mask);
+	return entry->desc;
 }
 
 page_desc_t * get_page_descriptor(void * address){
@@ -107,51 +434,160 @@ page_desc_t * get_page_descriptor(void * address){
 	return desc;
 }
 
-void set_page_descriptor(ptr_t address, page_desc_t * desc){
+/* invalidate_desc_caches ()
+ * note: must be called whenever a registered page is unmapped
+ *
+ * Each thread keeps a small cache of page descriptors; this bumps the
+ * generation they are checked against, so that they get flushed before
+ * their next lookup.
+ * Return value: none
+ */
+void invalidate_desc_caches(){
+	__atomic_add_fetch(&desc_cache_generation, 1, __ATOMIC_RELEASE);
+}
+
+/* desc_cache_stats (64bit pointer hits, 64bit pointer misses)
+ *
+ * Reports how many descriptor lookups of the calling thread were served
+ * by its cache, and how many needed a walk through the registers.
+ * Return value: none
+ */
+void compost_desc_cache_stats(size_t * hits, size_t * misses){
+	*hits = desc_cache_hits;
+	*misses = desc_cache_misses;
+}
+
+/* set_page_descriptor (pointer address, page_desc_t pointer desc)
+ * note: callers must hold pages_lock
+ *
+ * Registers the descriptor of a page. Registers skip the levels which
+ * are common to all the addresses they hold; their metadata tells which
+ * prefix they stand for, so that a page with another prefix makes an
+ * intermediate register split them. A register is always filled before
+ * it is linked, so that concurrent lookups never see a partial path.
+ * Return value: the entry of the final register, or NULL for the heap
+ */
+ptr_t * set_page_descriptor(ptr_t address, page_desc_t * desc){
+	if ((address.s - heap_base.s) < heap_size){
+		heap_table[(address.s - heap_base.s) >> page_relative_bits] = desc;
+		return NULL;
+	}
+	size_t md_bits = reg_md_mask << reg_i_bits;
 	ptr_t * reg = &first_reg;
-	ptr_t reg_ct = first_reg;
-	size_t i = first_reg.s & reg_i_mask;
-	ptr_t last_md;
-	do {
-		i = reg_ct.s & reg_i_mask;
-		if (i > page_relative_bits){
-			size_t relevant_bits = ((~(size_t)0) >> i) << i;
-			last_md = get_reg_metadata(SP(reg_ct.s & page_mask));
-			if ((last_md.s & relevant_bits) == (address.s & relevant_bits)){
-				reg = &(SP((reg_ct.s & page_mask)).p)[(address.s >> i) & reg_mask];
-				reg_ct = *reg;
-			} else break;
-		} else break;
-	} while (reg_ct.p != NULL);
-
-	if (i > page_relative_bits){
-		printf("Compost: new register (%lu)\n", i);
-		if (reg_ct.p != NULL){
-			ptr_t bck = reg_ct;
-			ptr_t intermediate = new_random_page(1);
+	while (true){
+		ptr_t reg_ct = *reg;
+		if ((reg_ct.s & page_mask) == 0){
+			printf("Compost: new register (%lu)\n", page_relative_bits);
+			ptr_t final_reg_page = new_register();
+			// final registers have metadata too:
+			set_reg_metadata(final_reg_page, address);
+			ptr_t * entry = &final_reg_page.p[(address.s >> page_relative_bits) & reg_mask];
+			entry->s |= (size_t)desc;
+			__atomic_store_n(&reg->s, (reg_ct.s & md_bits) | final_reg_page.s | page_relative_bits, __ATOMIC_RELEASE);
+			return entry;
+		}
+
+		size_t i = reg_ct.s & reg_i_mask;
+		ptr_t reg_page = SP(reg_ct.s & page_mask);
+		size_t upper = i + reg_part_bits;
+		size_t relevant_bits = (upper >= PTR_BITS) ? 0 : ((~(size_t)0) << upper);
+		size_t diff = (get_reg_metadata(reg_page).s ^ address.s) & relevant_bits;
+		if (diff){
+			// the address does not belong to this register: split at the highest differing part
+			size_t high_bit = PTR_BITS - 1 - __builtin_clzl(diff);
+			size_t j = page_relative_bits + ((high_bit - page_relative_bits) / reg_part_bits) * reg_part_bits;
+			printf("Compost: new register (%lu)\n", j);
+			ptr_t intermediate = new_register();
 			// non-final registers must have metadata:
 			set_reg_metadata(intermediate, address);
+			intermediate.p[(get_reg_metadata(reg_page).s >> j) & reg_mask].s |= reg_page.s | i;
+			__atomic_store_n(&reg->s, (reg_ct.s & md_bits) | intermediate.s | j, __ATOMIC_RELEASE);
+			reg = &intermediate.p[(address.s >> j) & reg_mask];
+		} else if (i > page_relative_bits){
+			reg = &reg_page.p[(address.s >> i) & reg_mask];
+		} else {
+			reg = &reg_page.p[(address.s >> i) & reg_mask];
+			__atomic_store_n(&reg->s, (reg->s & md_bits) | (size_t)desc, __ATOMIC_RELEASE);
+			return reg;
+		}
+	}
+}
 
-			for (i = reg_last_part_bits; i >= page_relative_bits; i -= reg_part_bits){
-				size_t relevant_bits = ((~(size_t)0) >> i) << i;
-				if ((last_md.s & relevant_bits) != (address.s & relevant_bits)) break;
-			}
-
-			reg->s &= (reg_md_mask << reg_i_bits);
-			reg->s |= (intermediate.s | i);
-			intermediate.p[(last_md.s >> i) & reg_mask].s |= bck.s;
-			reg = &(intermediate.p[(address.s >> i) & reg_mask]);
+/* set_page_descriptors (pointer address, 64bit contig_len, page_desc_t pointer desc)
+ * note: callers must hold pages_lock
+ *
+ * Registers the descriptor of a run of pages. The registers are walked
+ * once per final register the run spans; the following pages of each
+ * are set directly in its next entries.
+ * Return value: none
+ */
+void set_page_descriptors(ptr_t address, size_t contig_len, page_desc_t * desc){
+	size_t md_bits = reg_md_mask << reg_i_bits;
+	for (size_t j = 0; j < contig_len; ){
+		ptr_t page = SP(address.s + j * page_size);
+		ptr_t * entry = set_page_descriptor(page, desc);
+		j++;
+		if (entry == NULL) continue;
+		for (size_t k = (page.s >> page_relative_bits) & reg_mask; j < contig_len && k < reg_mask; j++, k++){
+			entry++;
+			__atomic_store_n(&entry->s, (entry->s & md_bits) | (size_t)desc, __ATOMIC_RELEASE);
 		}
+	}
+}
 
-		ptr_t final_reg_page = new_random_page(1);
+/* register_is_empty (private function)
+ *
+ * Return value: true if no entry of a register leads anywhere
+ */
+bool register_is_empty(ptr_t reg_page){
+	for (size_t j = 0; j <= reg_mask; j++){
+		if (reg_page.p[j].s & page_mask) return false;
+	}
+	return true;
+}
 
-		reg->s &= (reg_md_mask << reg_i_bits);
-		reg->s |= (final_reg_page.s | page_relative_bits);
-		reg = &(final_reg_page.p[(address.s >> page_relative_bits) & reg_mask]);
-	} else {
-		reg = &(SP((reg_ct.s & page_mask)).p)[(address.s >> page_relative_bits) & reg_mask];
+/* clear_page_descriptor (pointer address)
+ * note: callers must hold pages_lock
+ *
+ * Unregisters a page which is being unmapped, so that lookups for its
+ * addresses stop finding its descriptor. The registers this leaves
+ * empty are unlinked and recycled, from the final one up; the first
+ * register is always kept. Intermediate registers left with a single
+ * entry are not merged back.
+ * Return value: none
+ */
+void clear_page_descriptor(ptr_t address){
+	if ((address.s - heap_base.s) < heap_size){
+		heap_table[(address.s - heap_base.s) >> page_relative_bits] = NULL;
+		return;
+	}
+	size_t md_bits = reg_md_mask << reg_i_bits;
+	ptr_t * path[PTR_BITS];
+	size_t depth = 0;
+	ptr_t * reg = &first_reg;
+	while (true){
+		ptr_t reg_ct = *reg;
+		if ((reg_ct.s & page_mask) == 0) return;
+		size_t i = reg_ct.s & reg_i_mask;
+		ptr_t reg_page = SP(reg_ct.s & page_mask);
+		size_t upper = i + reg_part_bits;
+		size_t relevant_bits = (upper >= PTR_BITS) ? 0 : ((~(size_t)0) << upper);
+		// the page was never registered: no register stands for its prefix
+		if ((get_reg_metadata(reg_page).s ^ address.s) & relevant_bits) return;
+		path[depth++] = reg;
+		reg = &reg_page.p[(address.s >> i) & reg_mask];
+		if (i <= page_relative_bits) break;
+	}
+	if ((reg->s & page_mask) == 0) return;
+	__atomic_store_n(&reg->s, reg->s & md_bits, __ATOMIC_RELEASE);
+	while (depth > 1){
+		ptr_t * parent = path[--depth];
+		ptr_t reg_page = SP(parent->s & page_mask);
+		if (!register_is_empty(reg_page)) break;
+		__atomic_store_n(&parent->s, parent->s & md_bits, __ATOMIC_RELEASE);
+		free_register(reg_page);
 	}
-	reg->s = (size_t)desc;
+	invalidate_desc_caches();
 }
 
 void prepare_page_desc(page_desc_t * desc, vartype_t vartype, void * next, size_t contig_len, uint8_t flags){
@@ -160,4 +596,15 @@ void prepare_page_desc(page_desc_t * desc, vartype_t vartype, void * next, size_
 	desc->flags_and_limit = PP(desc);
 	desc->flags_and_limit.s += page_size * contig_len;
 	desc->flags_and_limit.s |= flags;
+	// no slot bookkeeping until prepare_page_slots is called
+	desc->bitmap = SP(PG_RAW_LIMIT(desc));
+	desc->next_free = PP(NULL);
+	desc->free_slots = 0;
+	desc->stride = 0;
+	desc->fresh = 0;
+	desc->unswept = false;
+	desc->marks = PP(NULL);
+	desc->mark_epoch = 0;
+	desc->next_young = PP(NULL);
+	desc->young = young_generation - 1;
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <string.h>
 #include "types/field.h"
 
 obj_info_t get_info(void * obj){
@@ -26,7 +27,8 @@ obj_info_t get_info(void * obj){
 	obj_info_t info;
 	if (type->flags & TYPE_ARRAY){
 		array_obj_t * array_obj = PG_REFC2(desc), * next_ap;
-		while ((next_ap = array_obj->next) != NULL){
+		if (PG_FLAGS(desc) & PAGE_CLASS) array_obj = class_segment(desc, obj);
+		else while ((next_ap = array_obj->next) != NULL){
 			if (obj < (void *)next_ap) break;
 			else array_obj = next_ap;
 		}
@@ -127,57 +129,101 @@ void * compost_get_c_object(void * obj){
 }
 
 
-/* prepare (context ctx, pointer obj, type_t pointer type)
- *
- * This function acts as a generic constructor for objects.
- * It runs through all the fields of the instance's type
- * and fills them with appropriate data, instanciating distant
- * fields if required.
- * Return value: The construct object
- */
 void zero(void * addr, size_t sz, char value){
-	for (size_t i = 0; i < sz; i++) *(char *)(addr + i) = value;
+	memset(addr, value, sz);
 }
-void * compost_prepare(void * obj, type_t * type){
-	if (type == NULL) type = compost_type_of(obj);
-	void * obj_c = compost_get_c_object(obj);
-	bool unprotect = compost_protect(obj);
+
+typedef struct prepared_field {
+	size_t delta; // field address - object address
+	vartype_t vartype;
+	uint8_t flags;
+} prepared_field_t;
+
+/* prepare_n (pointer array objs, 64bit n, type_t pointer type)
+ * note: all objects must be fresh instances of the same type,
+ * like the ones compost_spot_n gives.
+ *
+ * Same as compost_prepare for a batch of objects: the fields
+ * dictionnary of the type is only walked once, on the first object,
+ * and the other objects get the same treatment at the same offsets.
+ * Return value: none
+ */
+void compost_prepare_n(void ** objs, size_t n, type_t * type){
+	if (n == 0) return;
+	if (type == NULL) type = compost_type_of(objs[0]);
+	bool unprotect_buf[64], * unprotect = (n <= 64) ? unprotect_buf : malloc(n * sizeof(bool));
+	for (size_t i = 0; i < n; i++){
+		// one load: compost_protect would check the whole chain of referrers
+		void ** refc = compost_get_final_obj(objs[i]);
+		unprotect[i] = (*refc == NULL);
+		if (unprotect[i]) *refc = FAKE_DEPENDENT(refc);
+		gc_barrier(refc);
+	}
 
 	if (type->flags & TYPE_PRIMITIVE){
-		zero(obj_c, type->object_size, '\x00');
+		for (size_t i = 0; i < n; i++) zero(compost_get_c_object(objs[i]), type->object_size, '\x00');
 	} else {
+		size_t len = 0, cap = 16;
+		prepared_field_t fields_buf[16], * fields = fields_buf;
 		array str = { -1, NULL };
 		do {
 			compost_dict_get_next_index(type->dynamic_fields, &str);
 			if (str.data != NULL){
-				// compost_print_cstr(str);
-				void * field = compost_get_field(obj, str.length, str.data, true);
-				// printf(" (%p) is being prepared.\n", field);
+				void * field = compost_get_field(objs[0], str.length, str.data, true);
 				if (field){
 					vartype_t field_vartype = compost_vartype_of(field);
-					type_t * field_type = strip_variant(field_vartype);
 					if (field_vartype.type != NULL){
-						size_t should_zero = 0;
-
-						uint8_t field_flags = compost_get_flags(field);
-						if ((field_flags & FIBF_AUTO_INST)){
-							if ((field_flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
-								void * new_field = compost_spot_dependent(field, field_vartype);
-								compost_prepare(new_field, field_type);
-							} else if (field_flags & FIBF_POINTER){
-								should_zero = sizeof(void *); // independent pointer
-							} else compost_prepare(field, field_type); // nested
-						} else should_zero = (field_flags & FIBF_POINTER) ? sizeof(void *) : field_type->object_size; // do not auto instantiate
-
-						zero(field, should_zero, '\x00');
+						if (len == cap){
+							prepared_field_t * larger = malloc((cap *= 2) * sizeof(prepared_field_t));
+							for (size_t f = 0; f < len; f++) larger[f] = fields[f];
+							if (fields != fields_buf) free(fields);
+							fields = larger;
+						}
+						fields[len++] = (prepared_field_t){ field - objs[0], field_vartype, compost_get_flags(field) };
 					}
 				}
 			}
 		} while (str.data != NULL);
+
+		for (size_t i = 0; i < n; i++){
+			for (size_t f = 0; f < len; f++){
+				void * field = objs[i] + fields[f].delta;
+				type_t * field_type = strip_variant(fields[f].vartype);
+				uint8_t field_flags = fields[f].flags;
+				size_t should_zero = 0;
+
+				if ((field_flags & FIBF_AUTO_INST)){
+					if ((field_flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
+						void * new_field = compost_spot_dependent(field, fields[f].vartype);
+						compost_prepare(new_field, field_type);
+					} else if (field_flags & FIBF_POINTER){
+						should_zero = sizeof(void *); // independent pointer
+					} else compost_prepare(field, field_type); // nested
+				} else should_zero = (field_flags & FIBF_POINTER) ? sizeof(void *) : field_type->object_size; // do not auto instantiate
+
+				zero(field, should_zero, '\x00');
+			}
+		}
+		if (fields != fields_buf) free(fields);
 	}
 
-	if (unprotect) compost_unprotect(obj);
+	// the slots stay claimed until the caller protects them or a collection runs
+	for (size_t i = 0; i < n; i++){
+		if (unprotect[i]) *(void **)compost_get_final_obj(objs[i]) = NULL;
+	}
+	if (unprotect != unprotect_buf) free(unprotect);
+}
 
+/* prepare (context ctx, pointer obj, type_t pointer type)
+ *
+ * This function acts as a generic constructor for objects.
+ * It runs through all the fields of the instance's type
+ * and fills them with appropriate data, instanciating distant
+ * fields if required.
+ * Return value: The construct object
+ */
+void * compost_prepare(void * obj, type_t * type){
+	compost_prepare_n(&obj, 1, type);
 	return obj;
 }
 
@@ -190,6 +236,10 @@ void * detach_field(void * raw_refc, void * field){
 	void * dependent = *(void **)field;
 	if (dependent != NULL){
 		void ** distant_refc = find_raw_refc(dependent);
+		gc_barrier(distant_refc);
+		dirty_type(strip_variant(PG_TYPE2(get_page_descriptor(distant_refc))));
+		// the slot stays claimed: the caller still holds the dependent,
+		// the next collection releases it unless it is attached again
 		if (*distant_refc == raw_refc) *distant_refc = NULL;
 		else misbound_error();
 		*(void **)field = NULL;
@@ -201,6 +251,8 @@ void * attach_field(void * raw_refc, void * field, void * dependent){
 	void * bck = detach_field(raw_refc, field);
 	void ** distant_refc = find_raw_refc(dependent);
 	if ((*distant_refc != NULL) && (*distant_refc != FAKE_DEPENDENT(distant_refc))) misbound_error();
+	gc_barrier(distant_refc);
+	touch_page(get_page_descriptor(field));
 	*distant_refc = raw_refc;
 	*(void **)field = dependent;
 	return bck;
@@ -218,6 +270,112 @@ void * compost_attach_dependent(void * field, void * dependent_obj){
 	return ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT) ? attach_field(raw_refc, field, dependent_obj) : NULL;
 }
 
+/* find_dependent_field (private function)
+ *
+ * Scans the fields of an owner (every item, if the owner is an array)
+ * for the dependent field holding the specified object.
+ * Return value: the field, or NULL if no field holds the object
+ */
+void ** find_dependent_field(void ** owner_refc, void * dependent){
+	page_desc_t * desc = get_page_descriptor(owner_refc);
+	type_t * type = strip_variant(PG_TYPE2(desc));
+	size_t items = 1, item_size = 0;
+	void * c_object = (void *)owner_refc + GET_OFFSET_ZONE(type);
+	if (type->flags & TYPE_ARRAY){
+		array_obj_t * array_obj = (array_obj_t *)owner_refc;
+		if (array_obj->content_type == NULL) return NULL;
+		type = compost_get_c_object(array_obj->content_type);
+		items = array_obj->capacity;
+		item_size = type->object_size + type->offsets;
+		c_object = compost_array_get(array_obj, 0) + type->offsets;
+	}
+	for (size_t n = 0; n < items; n++, c_object += item_size){
+		for (size_t i = 0; i < type->object_size; i++){
+			uint8_t flags = GET_FIB(type, i)->flags;
+			void ** field = c_object + i;
+			if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT && *field == dependent) return field;
+		}
+	}
+	return NULL;
+}
+
+#define RELOCATED(r, a) ((PP(a).s - (r)->old_start) < (r)->size ? (void *)(a) + (r)->delta : (void *)(a))
+
+/* relocate_fields (private function)
+ *
+ * Fixes what points to the fields of a moved instance: dependents get
+ * the new reference counter of their owner, and the referrer chain of
+ * each referenced object gets the new address of the referencing field.
+ * Return value: none
+ */
+void relocate_fields(void * c_object, type_t * type, relocation_t * r){
+	for (size_t i = 0; i < type->object_size; i++){
+		uint8_t flags = GET_FIB(type, i)->flags;
+		void ** field = c_object + i;
+		if (*field == NULL) continue;
+		if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
+			void ** distant_refc = find_raw_refc(*field);
+			*distant_refc = RELOCATED(r, *distant_refc);
+		} else if ((flags & FIBF_REFERENCES) == FIBF_REFERENCES){
+			*field = RELOCATED(r, *field);
+			void ** refc = compost_get_final_obj(*field);
+			while (*refc != NULL && *refc != FAKE_DEPENDENT(refc) && RELOCATED(r, *refc) != field){
+				refc = get_previous_owner(RELOCATED(r, *refc));
+			}
+			if (*refc == NULL || *refc == FAKE_DEPENDENT(refc)) continue;
+			link_referrer(refc, field);
+			// the back link of the older referrer leads into the instance
+			void * older = RELOCATED(r, *get_previous_owner(field));
+			if (older != NULL && (compost_get_flags(older) & FIBF_BACK_LINK)) *get_back_link(older) = get_previous_owner(field);
+		}
+	}
+}
+
+/* relocate (pointer old_refc, pointer new_refc, 64bit size)
+ * note: this function is not meant to be used externally.
+ * note: the contents must have been copied; for arrays, the new
+ * header must already hold the content type and capacity.
+ *
+ * Makes every pointer to an instance (or array segment) of size bytes
+ * follow it to its new location: the owner's field or the referrers
+ * of the instance, the instance's own dependents and referrer chains.
+ * The old location is never read, as it may be unmapped already; the
+ * caller frees it.
+ * Return value: none
+ */
+void relocate(void ** old_refc, void ** new_refc, size_t size){
+	relocation_t r = { PP(old_refc).s, size, (void *)new_refc - (void *)old_refc };
+	void * incoming = *new_refc;
+	gc_barrier_relocate(old_refc, new_refc);
+	if (incoming == FAKE_DEPENDENT(old_refc)) *new_refc = FAKE_DEPENDENT(new_refc);
+	else if (incoming != NULL && (PG_FLAGS(get_page_descriptor(new_refc)) & PAGE_DEPENDENT)){
+		// no field may lead to the dependent anymore, its owner keeps it alive
+		void ** field = find_dependent_field(incoming, old_refc);
+		if (field != NULL) *field = new_refc;
+	} else {
+		// referrers may point inside the instance, or lie in it
+		void ** refc = new_refc;
+		while (*refc != NULL){
+			link_referrer(refc, RELOCATED(&r, *refc));
+			void ** field = *refc;
+			*field = RELOCATED(&r, *field);
+			refc = get_previous_owner(field);
+		}
+	}
+
+	type_t * type = strip_variant(PG_TYPE2(get_page_descriptor(new_refc)));
+	if (type->flags & TYPE_ARRAY){
+		array_obj_t * array_obj = (array_obj_t *)new_refc;
+		if (array_obj->content_type == NULL) return;
+		type = compost_get_c_object(array_obj->content_type);
+		size_t item_size = type->object_size + type->offsets;
+		size_t items = (size - sizeof(array_obj_t)) / item_size; // the moved items only
+		for (size_t n = 0; n < items && n < array_obj->capacity; n++){
+			relocate_fields(ARRAY_GET(array_obj, item_size, n) + type->offsets, type, &r);
+		}
+	} else relocate_fields((void *)new_refc + GET_OFFSET_ZONE(type), type, &r);
+}
+
 void ** get_previous_owner(void * ref_field){
 	obj_info_t info = get_info(ref_field);
 	info.offset -= info.offsets_zone;
@@ -230,6 +388,62 @@ void ** get_previous_owner(void * ref_field){
 	} while (fib->field_vartype.obj != (void *)info.offset);
 	return ref_field + prev_owner_i - info.offset;
 }
+
+/* get_back_link (pointer ref_field)
+ * note: this function is not meant to be used externally.
+ * note: the field must have the FIBF_BACK_LINK flag.
+ *
+ * The back link of a referencing field is the slot reserved right
+ * before its previous owner; it holds the address of the slot leading
+ * to the field in the chain, i.e. the reference counter of the
+ * referenced object or the previous owner of a newer referrer.
+ * Return value: a pointer to the back link
+ */
+void *** get_back_link(void * ref_field){
+	return (void ***)(get_previous_owner(ref_field) - 1);
+}
+
+/* link_referrer (pointer slot, pointer ref_field)
+ * note: this function is not meant to be used externally.
+ *
+ * Makes a slot of a referrer chain lead to a referencing field (or
+ * end the chain if it is NULL), keeping the back link of the field.
+ * Return value: none
+ */
+void link_referrer(void ** slot, void * ref_field){
+	*slot = ref_field;
+	if (ref_field != NULL && (compost_get_flags(ref_field) & FIBF_BACK_LINK)) *get_back_link(ref_field) = slot;
+}
+
+/* unlink_referrer (pointer slot)
+ * note: this function is not meant to be used externally.
+ *
+ * Takes the referencing field a slot leads to out of its chain; the
+ * back link of the field is cleared so that it never outlives the chain.
+ * Return value: none
+ */
+void unlink_referrer(void ** slot){
+	void * ref_field = *slot;
+	link_referrer(slot, *get_previous_owner(ref_field));
+	if (compost_get_flags(ref_field) & FIBF_BACK_LINK) *get_back_link(ref_field) = NULL;
+}
+
+/* find_referrer_slot (pointer refc, pointer ref_field)
+ * note: this function is not meant to be used externally.
+ *
+ * Finds the slot leading to a referencing field in the chain of a
+ * reference counter: read from the back link of the field if it has
+ * one, otherwise found by walking the chain.
+ * Return value: the slot, which holds NULL if the field is not in the chain
+ */
+void ** find_referrer_slot(void ** refc, void * ref_field){
+	if (compost_get_flags(ref_field) & FIBF_BACK_LINK){
+		void ** slot = *get_back_link(ref_field);
+		if (slot != NULL && *slot == ref_field) return slot;
+	}
+	while (*refc != ref_field && *refc != NULL) refc = get_previous_owner(*refc);
+	return refc;
+}
 /*
  * WARNING
  * protected objects should never be unprotected
@@ -241,9 +455,12 @@ void compost_set_reference(void * field, void * obj){
 		compost_clear_reference(field);
 		if (obj != NULL){
 			void ** refc = compost_get_final_obj(obj);
-			if (!is_obj_protected(refc)){
-				if (*refc != NULL) *get_previous_owner(field) = *refc;
-				*refc = field;
+			gc_barrier(refc);
+			// the page of the field may now lead to a young object
+			touch_page(get_page_descriptor(field));
+			if (*refc != FAKE_DEPENDENT(refc)){
+				link_referrer(get_previous_owner(field), *refc);
+				link_referrer(refc, field);
 			}
 		}
 	} else misbound_error(); // maybe tmp but i wanna know if it happens
@@ -253,21 +470,23 @@ void compost_set_reference(void * field, void * obj){
 void compost_clear_reference(void * field){
 	uint8_t flags = compost_get_flags(field);
 	if ((flags & FIBF_REFERENCES) == FIBF_REFERENCES && *(void **)field != NULL){
-		void ** refc = compost_get_final_obj(*(void **)field);
-		if (!is_obj_protected(refc)){
-			while (*refc != field && *refc != NULL){
-				refc = get_previous_owner(*refc);
-			}
-			*refc = *get_previous_owner(field);
+		void ** target_refc = compost_get_final_obj(*(void **)field);
+		gc_barrier(target_refc);
+		dirty_type(strip_variant(PG_TYPE2(get_page_descriptor(target_refc))));
+		// one load: is_obj_protected would walk the whole chain
+		if (*target_refc != FAKE_DEPENDENT(target_refc)){
+			void ** refc = find_referrer_slot(target_refc, field);
+			if (*refc == field) unlink_referrer(refc);
+			if (*target_refc == NULL) free_slot(target_refc);
 		}
 	}
 	*(void **)field = NULL;
 }
 
 void check_references(void ** refc, recursive_call_t * rec){
-	// check for infinite recursive calls:
 	recursive_call_t next_rec = { refc, rec };
 	while (rec){
+		// check for infinite recursive calls:
 		if (rec->arg == refc) return;
 		else rec = rec->next;
 	}
@@ -276,23 +495,139 @@ void check_references(void ** refc, recursive_call_t * rec){
 		if (*find_refc(*refc, &next_rec) == NULL){
 			// detach
 			*(void **)*refc = NULL;
-			*refc = *prev_owner;
+			unlink_referrer(refc);
 		} else refc = prev_owner;
 	}
 }
 
-void reset_fields(void * c_object, type_t * type){
+/* build_reset_plan (private function)
+ *
+ * Lists the fields which reset_fields must handle one by one: dependent,
+ * malloc'd and referencing fields. The plan is kept in the runtime of
+ * the type until compost_set_dynamic_field changes the type.
+ * Return value: none
+ */
+void build_reset_plan(type_t * type, type_runtime_t * runtime){
+	size_t steps = 0;
 	for (size_t i = 0; i < type->object_size; i++){
 		uint8_t flags = GET_FIB(type, i)->flags;
-		void * field = c_object + i;
-		if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
-			detach_field(find_raw_refc(c_object), field);
-		} else if ((flags & FIBF_MALLOC) && (*(void **)field != NULL)){
-			free(*(void **)field);
-		} else if ((flags & FIBF_REFERENCES) && (*(void **)field != NULL)){
-			compost_clear_reference(field);
+		if (NEEDS_RESET_STEP(flags)){
+			if (steps < RESET_PLAN_SIZE) runtime->reset_plan[steps] = (reset_step_t){ i, flags };
+			steps++;
+		}
+	}
+	runtime->reset_steps = steps;
+	__atomic_store_n(&runtime->reset_plan_ready, true, __ATOMIC_RELEASE);
+}
+
+/* get_reset_plan (type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Return value: the runtime of the type, its reset plan being ready
+ */
+type_runtime_t * get_reset_plan(type_t * type){
+	type_runtime_t * runtime = get_runtime(type);
+	if (!__atomic_load_n(&runtime->reset_plan_ready, __ATOMIC_ACQUIRE)) build_reset_plan(type, runtime);
+	return runtime;
+}
+
+void reset_field(void * c_object, void * field, uint8_t flags){
+	if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
+		detach_field(find_raw_refc(c_object), field);
+	} else if (*(void **)field != NULL){
+		if (flags & FIBF_MALLOC) free(*(void **)field);
+		else compost_clear_reference(field);
+	}
+}
+
+/* reset_fields (pointer c_object, type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Detaches the dependents of an instance, frees its malloc'd fields,
+ * clears its references, then zeroes it. Only the fields listed by the
+ * reset plan of the type are looked at, unless they are too many.
+ * Return value: none
+ */
+void reset_fields(void * c_object, type_t * type){
+	// instances of the root type are types, whose runtime is not a field
+	if (type->flags & TYPE_ROOT) free_runtime(c_object);
+	type_runtime_t * runtime = get_reset_plan(type);
+	if (runtime->reset_steps <= RESET_PLAN_SIZE){
+		for (size_t s = 0; s < runtime->reset_steps; s++){
+			reset_step_t * step = &runtime->reset_plan[s];
+			reset_field(c_object, c_object + step->offset, step->flags);
 		}
-		*(char *)field = '\0';
+	} else for (size_t i = 0; i < type->object_size; i++){
+		uint8_t flags = GET_FIB(type, i)->flags;
+		if (NEEDS_RESET_STEP(flags)) reset_field(c_object, c_object + i, flags);
+	}
+	memset(c_object, 0, type->object_size);
+}
+
+void trace_field(void * field, uint8_t flags, mark_stack_t * stack){
+	void * target = *(void **)field;
+	if (target == NULL) return;
+	if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT) push_mark(stack, find_raw_refc(target));
+	else if ((flags & FIBF_REFERENCES) == FIBF_REFERENCES){
+		void ** refc = compost_get_final_obj(target);
+		// a referent whose counter is cleared has already been freed
+		if (*refc != NULL) push_mark(stack, refc);
+	}
+}
+
+/* trace_fields (pointer c_object, type_t pointer type, mark_stack_t pointer stack)
+ * note: this function is not meant to be used externally.
+ *
+ * Pushes the dependents and the referents of an instance on the mark
+ * stack, following the reset plan of its type like reset_fields.
+ * Return value: none
+ */
+void trace_fields(void * c_object, type_t * type, mark_stack_t * stack){
+	type_runtime_t * runtime = get_reset_plan(type);
+	if (runtime->reset_steps <= RESET_PLAN_SIZE){
+		for (size_t s = 0; s < runtime->reset_steps; s++){
+			reset_step_t * step = &runtime->reset_plan[s];
+			trace_field(c_object + step->offset, step->flags, stack);
+		}
+	} else for (size_t i = 0; i < type->object_size; i++){
+		trace_field(c_object + i, GET_FIB(type, i)->flags, stack);
+	}
+}
+
+/* unlink_field (pointer c_object, pointer field, 8bit flags)
+ * note: this function is not meant to be used externally.
+ *
+ * Same as reset_field, for a dead instance which a minor collection
+ * zeroes: only the live objects it leads to are updated, the dead ones
+ * being zeroed as well, and its malloc'd fields are left to sweep_fields.
+ * Return value: none
+ */
+void unlink_field(void * c_object, void * field, uint8_t flags){
+	void * target = *(void **)field;
+	if (target == NULL) return;
+	if ((flags & FIBF_DEPENDENT) == FIBF_DEPENDENT){
+		void ** distant_refc = find_raw_refc(target);
+		if (is_slot_marked(distant_refc) && *distant_refc == find_raw_refc(c_object)) *distant_refc = NULL;
+		*(void **)field = NULL;
+	} else if ((flags & FIBF_REFERENCES) == FIBF_REFERENCES){
+		void ** refc = compost_get_final_obj(target);
+		if (*refc != FAKE_DEPENDENT(refc) && is_slot_alive(refc)){
+			refc = find_referrer_slot(refc, field);
+			if (*refc == field) unlink_referrer(refc);
+		}
+		*(void **)field = NULL;
+	}
+}
+
+void unlink_fields(void * c_object, type_t * type){
+	type_runtime_t * runtime = get_reset_plan(type);
+	if (runtime->reset_steps <= RESET_PLAN_SIZE){
+		for (size_t s = 0; s < runtime->reset_steps; s++){
+			reset_step_t * step = &runtime->reset_plan[s];
+			unlink_field(c_object, c_object + step->offset, step->flags);
+		}
+	} else for (size_t i = 0; i < type->object_size; i++){
+		unlink_field(c_object, c_object + i, GET_FIB(type, i)->flags);
 	}
 }
 
@@ -319,6 +654,7 @@ void * compost_create_type(void * any_paged_obj, size_t nested_objects, size_t r
 	new_type->object_size = object_size;
 	new_type->offsets = offsets;
 	new_type->page_list = NULL;
+	new_type->runtime = NULL;
 	new_type->flags = flags;
 
 	void * dyn_f = compost_spot_dependent(&new_type->dynamic_fields, (vartype_t){ &rp->dht });
@@ -386,7 +722,8 @@ void find_and_fill_prev_owner(type_t * host_type, size_t fib_offset){
 }
 
 /* compost_set_dynamic_field (type_t pointer type, type_t pointer field_type, 64bit offset, 8bit flags)
- * note: flags must be a combination of FIBF_BASIC, FIBF_POINTER, FIBF_DEPENDENT, FIBF_ARRAY and FIBF_AUTO_INST.
+ * note: flags must be a combination of FIBF_BASIC, FIBF_POINTER, FIBF_DEPENDENT, FIBF_REFERENCES, FIBF_BACK_LINK and FIBF_AUTO_INST.
+ * note: a referencing field takes one referencer slot of the type, two with FIBF_BACK_LINK.
  * note: offset must be inferior to the type's object_size field.
  *
  * This function is the main way of adding a field to a type. It handles
@@ -425,6 +762,10 @@ size_t compost_set_dynamic_field(type_t * host_type, vartype_t field_vartype, ar
 				if ((fib->flags & FIBF_REFERENCES) == FIBF_REFERENCES){
 					find_and_fill_prev_owner(host_type, fib_offset + i);
 					ref_fields_count++;
+					if (fib->flags & FIBF_BACK_LINK){
+						find_and_fill_prev_owner(host_type, fib_offset + i);
+						ref_fields_count++;
+					}
 				}
 				*GET_FIB(host_type, fib_offset + i) = *fib;
 			}
@@ -441,9 +782,13 @@ size_t compost_set_dynamic_field(type_t * host_type, vartype_t field_vartype, ar
 		}
 		if ((flags & FIBF_REFERENCES) == FIBF_REFERENCES){
 			find_and_fill_prev_owner(host_type, fib_offset);
+			// the back link takes the next referencer slot
+			if (flags & FIBF_BACK_LINK) find_and_fill_prev_owner(host_type, fib_offset);
 		}
 	}
 	compost_dict_set_pa(host_type->dynamic_fields, field_name, compost_get_obj(field_info));
+	type_runtime_t * runtime = host_type->runtime;
+	if (runtime != NULL) runtime->reset_plan_ready = false;
 	return field_size;
 }
 
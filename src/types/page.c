@@ -22,58 +22,628 @@
 size_t page_size;
 size_t page_rel_mask;
 size_t page_mask;
+size_t system_page_size;
+size_t compost_page_size = 0;
 size_t compost_pages = 0;
+page_desc_t * empty_pages = NULL;
+pthread_mutex_t pages_lock = PTHREAD_MUTEX_INITIALIZER;
+size_t magazine_generation = 0;
+size_t compost_large_array_bytes = 0;
+size_t collection_epoch = 0;
+page_desc_t * young_pages = NULL;
+size_t young_generation = 0;
+pthread_mutex_t young_lock = PTHREAD_MUTEX_INITIALIZER;
+size_t compost_retain_type_pages = RETAIN_TYPE_PAGES;
+size_t compost_retain_pages = RETAIN_PAGES;
+size_t compost_retain_low = RETAIN_LOW;
+size_t compost_retained_pages = 0;
+retained_page_t * retained_pages = NULL;
+size_t retained_global = 0;
 
 // called automatically before main, to get page_size from the system cfg :
 __attribute__((constructor))
 void get_system_paging_config(){
-	page_size = sysconf(_SC_PAGE_SIZE);
+	system_page_size = sysconf(_SC_PAGE_SIZE);
+	set_page_unit(system_page_size);
+}
+
+/* set_page_unit (64bit unit)
+ * note: no page may be mapped yet, except for the first register.
+ *
+ * Sets the size of Compost pages, which is also the size of the
+ * registers and the granularity of the page descriptors. The first
+ * register, mapped for the previous unit, is dropped.
+ * Return value: none
+ */
+void set_page_unit(size_t unit){
+	if (first_reg.p != NULL){
+		munmap(SP(first_reg.s & page_mask).p, REG_SLAB_PAGES * page_size);
+		reg_slab_left = 0;
+		compost_registers = 0;
+	}
+	bool default_large = compost_large_array_bytes == ARRAY_LARGE_PAGES * page_size;
+	page_size = unit;
 	page_rel_mask = page_size - 1; // typically 0x...00000fff
 	page_mask = ~page_rel_mask;        // typically 0x...fffff000
+	if (default_large) compost_large_array_bytes = ARRAY_LARGE_PAGES * page_size;
 	compute_regs_config();
 }
 
+/* setup_page_unit ()
+ * note: called by compost_setup, before any page is mapped
+ *
+ * Switches to compost_page_size if it was set, and makes sure that the
+ * chunks hold a few clusters of pages of this size.
+ * Return value: none
+ */
+void setup_page_unit(){
+	size_t unit = compost_page_size;
+	if (unit && unit != page_size){
+		if (unit < system_page_size || (unit & (unit - 1))){
+			printf("Compost: the page size must be a power of two multiple of %lu, using %lu.\n", system_page_size, page_size);
+		} else set_page_unit(unit);
+	}
+	compost_page_size = page_size;
+	compost_chunk_bytes &= page_mask;
+	if (compost_chunk_bytes < 2 * CLUSTER_PAGES * page_size) compost_chunk_bytes = 2 * CLUSTER_PAGES * page_size;
+}
+
+/* array_class (64bit segment_bytes)
+ *
+ * Finds the smallest size class which fits a segment (header included).
+ * Return value: the class index, or -1 if the segment needs a first-fit page
+ */
+int array_class(size_t segment_bytes){
+	for (int c = 0; c < ARRAY_CLASSES && ARRAY_CLASS_SIZE(c) <= page_size / ARRAY_CLASS_MIN_SEGMENTS; c++){
+		if (segment_bytes <= ARRAY_CLASS_SIZE(c)) return c;
+	}
+	return -1;
+}
+
+page_desc_t ** free_list_of(type_runtime_t * runtime, page_desc_t * desc){
+	uint8_t flags = PG_FLAGS(desc);
+	if (flags & PAGE_CLASS) return &runtime->class_pages[array_class(desc->stride)][PG_FREE_LIST(flags)];
+	else return &runtime->free_pages[PG_FREE_LIST(flags)];
+}
+
+void push_free_page(type_runtime_t * runtime, page_desc_t * desc){
+	page_desc_t ** head = free_list_of(runtime, desc);
+	desc->next_free = PP(*head);
+	*head = desc;
+}
+
+void fill_free_pages(type_runtime_t * runtime, type_t * type){
+	runtime->free_pages[0] = runtime->free_pages[1] = NULL;
+	for (int c = 0; c < ARRAY_CLASSES; c++) runtime->class_pages[c][0] = runtime->class_pages[c][1] = NULL;
+	for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)){
+		if (PG_HAS_SLOTS(desc) && desc->free_slots) push_free_page(runtime, desc);
+	}
+}
+
+/* get_runtime (type_t pointer type)
+ *
+ * Fetches the allocation state of a type, creating it on first use.
+ * Pages which were mapped before (by compost_setup) are registered
+ * in the free lists at this moment.
+ * Return value: the runtime structure of the type
+ */
+type_runtime_t * get_runtime(type_t * type){
+	type_runtime_t * runtime = __atomic_load_n((type_runtime_t **)&type->runtime, __ATOMIC_ACQUIRE);
+	if (runtime == NULL){
+		pthread_mutex_lock(&pages_lock);
+		runtime = type->runtime;
+		if (runtime == NULL){
+			runtime = calloc(1, sizeof(type_runtime_t));
+			runtime->growth_pages = runtime->growth_next = 1;
+			pthread_mutex_init(&runtime->lock, NULL);
+			runtime->dirty = true;
+			fill_free_pages(runtime, type);
+			__atomic_store_n((type_runtime_t **)&type->runtime, runtime, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&pages_lock);
+	}
+	return runtime;
+}
+
+/* rebuild_free_pages (type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Recreates the free lists of a type from its page list; the
+ * garbage collector calls this after unmapping pages.
+ * Return value: none
+ */
+void rebuild_free_pages(type_t * type){
+	type_runtime_t * runtime = type->runtime;
+	if (runtime == NULL) return;
+	pthread_mutex_lock(&runtime->lock);
+	fill_free_pages(runtime, type);
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* prepare_page_slots (page_desc_t pointer desc, 64bit stride)
+ *
+ * Splits a page into slots of stride bytes followed by an occupancy bitmap,
+ * holding one bit per slot. A bit is set while its slot is claimed;
+ * the bits which do not match a slot are set so that they never look free.
+ * Return value: none
+ */
+void prepare_page_slots(page_desc_t * desc, size_t stride){
+	size_t first = PP(PG_REFC2(desc)).s, end = PG_RAW_LIMIT(desc);
+	size_t slots = (end - first) / stride;
+	while (ALIGN_UP(first + slots * stride, PTRSZ) + CEILDIV(slots, 64) * sizeof(uint64_t) > end) slots--;
+	desc->bitmap.s = ALIGN_UP(first + slots * stride, PTRSZ);
+	desc->stride = stride;
+
+	uint64_t * bitmap = PG_BITMAP(desc);
+	size_t words = CEILDIV(slots, 64);
+	for (size_t i = 0; i < words; i++) bitmap[i] = 0;
+	if (slots % 64) bitmap[words - 1] = (~(uint64_t)0) << (slots % 64);
+	desc->free_slots = slots;
+}
+
+/* claim_used_slots (page_desc_t pointer desc)
+ * note: only compost_setup needs this, for its statically filled pages.
+ *
+ * Sets the occupancy bits of the slots which already hold an object.
+ * Return value: none
+ */
+void claim_used_slots(page_desc_t * desc){
+	uint64_t * bitmap = PG_BITMAP(desc);
+	size_t slots = PG_SLOTS(desc);
+	desc->fresh = slots; // no slot is known to be untouched
+	for (size_t i = 0; i < slots; i++){
+		void ** refc = PG_SLOT(desc, i);
+		if (*refc != NULL && !(bitmap[i / 64] & ((uint64_t)1 << (i % 64)))){
+			bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+			desc->free_slots--;
+		}
+	}
+}
+
+/* claim_slots (private function)
+ *
+ * Claims up to max free slots of a page using its occupancy bitmap,
+ * a whole bitmap word at a time. Slots which were released and then
+ * protected again stay claimed but are not returned. Slots which were
+ * never used before are tagged with FRESH_SLOT.
+ * Return value: the number of slots written to out
+ */
+size_t claim_slots(page_desc_t * desc, void ** out, size_t max){
+	uint64_t * bitmap = PG_BITMAP(desc);
+	size_t words = CEILDIV(PG_SLOTS(desc), 64), n = 0;
+	touch_page(desc);
+	for (size_t w = 0; w < words && n < max && desc->free_slots; w++){
+		uint64_t free_bits = ~bitmap[w];
+		while (free_bits && n < max){
+			size_t bit = __builtin_ctzll(free_bits);
+			free_bits &= free_bits - 1;
+			bitmap[w] |= (uint64_t)1 << bit;
+			desc->free_slots--;
+			size_t i = w * 64 + bit;
+			void ** refc = PG_SLOT(desc, i);
+			if (i >= desc->fresh){
+				// never used: zeroed by the system, not even read
+				desc->fresh = i + 1;
+				out[n++] = (void *)(PP(refc).s | FRESH_SLOT);
+			} else if (*refc == NULL) out[n++] = refc;
+			else continue;
+			// an incremental sweep must not release it before it is used
+			if (gc_cursor.phase == GC_SWEEP) mark_slot(refc);
+		}
+	}
+	return n;
+}
+
+void release_slot_locked(page_desc_t * desc, type_t * type, void * raw_refc){
+	size_t i = PG_SLOT_INDEX(desc, raw_refc);
+	uint64_t * word = PG_BITMAP(desc) + (i / 64), bit = (uint64_t)1 << (i % 64);
+	if (*word & bit){
+		*word &= ~bit;
+		desc->unswept = true;
+		if (desc->free_slots++ == 0) push_free_page(type->runtime, desc);
+	}
+}
+
+/* release_slot (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Clears the occupancy bit of a slot whose reference counter has just been
+ * cleared, so that it can be spotted again. Array pages have no bitmap
+ * and are ignored.
+ * Return value: none
+ */
+void release_slot(void * raw_refc){
+	page_desc_t * desc = get_page_descriptor(raw_refc);
+	if (!PG_HAS_SLOTS(desc)) return;
+	type_t * type = strip_variant(PG_TYPE2(desc));
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+	release_slot_locked(desc, type, raw_refc);
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* flush_magazine (private function)
+ *
+ * Gives the slots of a magazine back to their pages.
+ * Return value: none
+ */
+void flush_magazine(magazine_t * mag){
+	if (mag->count == 0) return;
+	type_runtime_t * runtime = get_runtime(mag->type);
+	pthread_mutex_lock(&runtime->lock);
+	while (mag->count){
+		void ** refc = UNTAG_SLOT(mag->slots[--mag->count]);
+		// the slot may have been protected again since it was freed
+		if (*refc == NULL) release_slot_locked(get_page_descriptor(refc), mag->type, refc);
+	}
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* get_magazine (private function)
+ *
+ * Finds the magazine of the calling thread for a type and a page kind;
+ * magazines are direct-mapped, so the previous user of the entry is flushed.
+ * A magazine filled before the last garbage collection is forgotten: the
+ * collector has already released its slots.
+ * Return value: the magazine
+ */
+magazine_t * get_magazine(type_t * type, uint8_t flags){
+	magazine_t * mag = &magazines[((PP(type).s >> 4) ^ flags) % MAGAZINES];
+	size_t generation = __atomic_load_n(&magazine_generation, __ATOMIC_ACQUIRE);
+	if (mag->generation != generation){
+		mag->generation = generation;
+		mag->count = 0;
+		mag->type = NULL;
+	}
+	if (mag->type != type || mag->flags != flags){
+		if (mag->type != NULL) flush_magazine(mag);
+		mag->type = type;
+		mag->flags = flags;
+	}
+	return mag;
+}
+
+/* free_slot (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Same as release_slot, but the slot is kept in the magazine of the
+ * calling thread while it has room, so that it is spotted again
+ * without taking the lock of its type. An object freed by a thread
+ * must not be protected again by another thread.
+ * Return value: none
+ */
+void free_slot(void * raw_refc){
+	page_desc_t * desc = get_page_descriptor(raw_refc);
+	dirty_type(strip_variant(PG_TYPE2(desc)));
+	if (!PG_HAS_SLOTS(desc)) return;
+	// array segments of all classes share their type: no magazine for them
+	if (PG_FLAGS(desc) & PAGE_CLASS) return release_slot(raw_refc);
+	magazine_t * mag = get_magazine(strip_variant(PG_TYPE2(desc)), PG_FLAGS(desc));
+	// a freed slot may be protected and freed again before being spotted
+	for (size_t i = 0; i < mag->count; i++){
+		if (UNTAG_SLOT(mag->slots[i]) == raw_refc) return;
+	}
+	if (mag->count < MAGAZINE_SIZE) mag->slots[mag->count++] = raw_refc;
+	else release_slot(raw_refc);
+}
+
+/* flush_magazines ()
+ *
+ * Gives every slot cached by the calling thread back to its page;
+ * a thread should call this before exiting.
+ * Return value: none
+ */
+void compost_flush_magazines(){
+	size_t generation = __atomic_load_n(&magazine_generation, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < MAGAZINES; i++){
+		if (magazines[i].generation == generation && magazines[i].type != NULL) flush_magazine(&magazines[i]);
+		magazines[i].type = NULL;
+	}
+}
+
+/* invalidate_magazines ()
+ * note: this function is not meant to be used externally.
+ *
+ * Makes every thread forget its magazines; called once the garbage
+ * collector has released all the unused slots.
+ * Return value: none
+ */
+void invalidate_magazines(){
+	__atomic_add_fetch(&magazine_generation, 1, __ATOMIC_RELEASE);
+}
+
+/* reuse_retained_page (private function)
+ * note: the lock of the type and pages_lock must be held
+ *
+ * Takes retained pages of the given length back, from the pool of the
+ * type first, then from the global pool. They are still registered.
+ * Return value: the first page, or NULL if none of this length is retained
+ */
+ptr_t reuse_retained_page(type_runtime_t * runtime, size_t contig_len){
+	retained_page_t ** link = &runtime->retained;
+	size_t * count = &runtime->retained_count;
+	for (int pool = 0; pool < 2; pool++){
+		for (; *link != NULL; link = &(*link)->next){
+			retained_page_t * node = *link;
+			if (node->contig_len != contig_len) continue;
+			ptr_t page = PP(node->page);
+			*link = node->next;
+			*count -= contig_len;
+			compost_retained_pages -= contig_len;
+			free(node);
+			return page;
+		}
+		link = &retained_pages;
+		count = &retained_global;
+	}
+	return PP(NULL);
+}
+
+/* release_cluster (private function)
+ * note: pages_lock must be held
+ *
+ * Gives back the pages of the cluster of a type which were not taken
+ * yet; they were never registered.
+ * Return value: none
+ */
+void release_cluster(type_runtime_t * runtime){
+	if (runtime->cluster_left) release_pages(runtime->cluster.p, runtime->cluster_left);
+	runtime->cluster = PP(NULL);
+	runtime->cluster_left = 0;
+}
+
+/* free_runtime (type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Destroys the runtime state of a dead type, when the root type sweeps
+ * it: the pages it retained go to the global pool, which gets trimmed,
+ * and the rest of its cluster is given back.
+ * Return value: none
+ */
+void free_runtime(type_t * type){
+	type_runtime_t * runtime = type->runtime;
+	if (runtime == NULL) return;
+	type->runtime = NULL;
+	pthread_mutex_lock(&pages_lock);
+	while (runtime->retained != NULL){
+		retained_page_t * node = runtime->retained;
+		runtime->retained = node->next;
+		node->next = retained_pages;
+		retained_pages = node;
+		retained_global += node->contig_len;
+	}
+	release_cluster(runtime);
+	if (retained_global > compost_retain_pages) trim_retained_pages(compost_retain_low);
+	pthread_mutex_unlock(&pages_lock);
+	pthread_mutex_destroy(&runtime->lock);
+	free(runtime);
+}
+
+/* cluster_pages (private function)
+ * note: the lock of the type and pages_lock must be held
+ *
+ * Takes contig_len pages from the cluster of the type, carving a new
+ * cluster once it is used up; the pages a run does not fit in are
+ * given back first, otherwise their chunk could never be unmapped.
+ * Runs longer than a cluster get pages of their own.
+ * Return value: the first page
+ */
+ptr_t cluster_pages(type_runtime_t * runtime, size_t contig_len){
+	if (contig_len > runtime->cluster_left){
+		if (contig_len >= CLUSTER_PAGES) return new_random_page(contig_len);
+		release_cluster(runtime);
+		runtime->cluster = new_random_page(CLUSTER_PAGES);
+		runtime->cluster_left = CLUSTER_PAGES;
+	}
+	ptr_t page = runtime->cluster;
+	runtime->cluster.s += contig_len * page_size;
+	runtime->cluster_left -= contig_len;
+	return page;
+}
+
+page_desc_t * map_pages(vartype_t vartype, type_t * type, uint8_t flags, size_t contig_len){
+	pthread_mutex_lock(&pages_lock);
+	ptr_t page = (flags & PAGE_LARGE) ? PP(NULL) : reuse_retained_page(type->runtime, contig_len);
+	bool registered = page.p != NULL;
+	if (!registered) page = (flags & PAGE_LARGE) ? new_private_pages(contig_len) : cluster_pages(type->runtime, contig_len);
+	page_desc_t * desc = (page_desc_t *)page.p;
+	prepare_page_desc(desc, vartype, type->page_list, contig_len, flags);
+	size_t pg_limit = PG_LIMIT(desc, type);
+	// a retained run may have been registered up to a lower limit only
+	ptr_t first = registered ? SP(page.s + page_size) : page;
+	size_t limit_bytes = pg_limit - first.s;
+	if (first.s < pg_limit) set_page_descriptors(first, CEILDIV(limit_bytes, page_size), desc);
+	compost_pages += contig_len;
+	pthread_mutex_unlock(&pages_lock);
+	if (!(type->flags & TYPE_ARRAY)) prepare_page_slots(desc, type->paged_size);
+	// the barriers of an incremental collection may mark it at any time
+	if (gc_cursor.phase != GC_IDLE) prepare_marks(desc);
+	if (!(type->flags & TYPE_ARRAY)) push_free_page(type->runtime, desc);
+
+	type->page_list = desc;
+	return desc;
+}
+
+/* growth_run (private function)
+ * note: the lock of the type must be held
+ *
+ * Decides how many pages a type maps when it runs out of slots, given
+ * the pages needed for the slots requested. Types holding retained pages
+ * ask for no more, so that these are reused first.
+ * Return value: the length of the run
+ */
+size_t growth_run(type_runtime_t * runtime, size_t needed){
+	if (runtime->retained != NULL) return needed;
+	size_t run = runtime->growth_pages;
+	if (runtime->growth != GROWTH_FIXED){
+		run = runtime->growth_next;
+		runtime->growth_next *= 2;
+		if (runtime->growth_next > runtime->growth_pages) runtime->growth_next = runtime->growth_pages;
+	}
+	return run > needed ? run : needed;
+}
+
+/* compost_set_growth (type_t pointer type, 8bit policy, 64bit pages)
+ *
+ * Sets how many pages the type maps at once when it runs out of slots:
+ * pages for GROWTH_FIXED, or up to pages for GROWTH_GEOMETRIC and
+ * GROWTH_ADAPTIVE, which start again from one page. Array types map
+ * their pages as their arrays need, and ignore this.
+ * Return value: none
+ */
+void compost_set_growth(type_t * type, uint8_t policy, size_t pages){
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+	runtime->growth = policy;
+	runtime->growth_pages = pages ? pages : 1;
+	runtime->growth_next = 1;
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* fill_slots (private function)
+ * note: the lock of the type must be held
+ *
+ * Claims n slots from the pages of a type having free slots. When
+ * none is left, the pages needed for all the remaining slots are
+ * mapped at once, as one contiguous block, which the growth policy
+ * of the type may lengthen.
+ * Return value: none
+ */
+void fill_slots(vartype_t vartype, type_t * type, uint8_t flags, void ** out, size_t n){
+	page_desc_t ** head = &((type_runtime_t *)type->runtime)->free_pages[PG_FREE_LIST(flags)];
+	size_t got = 0;
+	// the slots may never be protected nor referenced
+	dirty_type(type);
+	while (got < n){
+		if (*head == NULL){
+			size_t left = n - got;
+			size_t bytes = sizeof(page_desc_t) + left * type->paged_size + PTRSZ + CEILDIV(left, 64) * sizeof(uint64_t);
+			map_pages(vartype, type, flags, growth_run(type->runtime, CEILDIV(bytes, page_size)));
+		}
+		page_desc_t * desc = *head;
+		got += claim_slots(desc, out + got, n - got);
+		if (desc->free_slots == 0) *head = (page_desc_t *)desc->next_free.p;
+	}
+}
+
+/* refill_magazine (private function)
+ *
+ * Claims a batch of slots for a magazine under the lock of the type.
+ * Return value: none
+ */
+void refill_magazine(magazine_t * mag, vartype_t vartype, type_t * type, uint8_t flags){
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+	fill_slots(vartype, type, flags, mag->slots + mag->count, MAGAZINE_BATCH - mag->count);
+	mag->count = MAGAZINE_BATCH;
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* spot_slot (private function)
+ *
+ * Spots an instance of a non-array type from the magazine of the calling
+ * thread, which is refilled in batches once empty.
+ * Return value: the reference counter of the spotted slot
+ */
+void * spot_slot(vartype_t vartype, type_t * type, uint8_t flags){
+	magazine_t * mag = get_magazine(type, flags);
+	while (true){
+		while (mag->count){
+			void * slot = mag->slots[--mag->count];
+			void ** refc = UNTAG_SLOT(slot);
+			if (slot != (void *)refc) return refc;
+			if (*refc == NULL){
+				reset_fields((void *)refc + GET_OFFSET_ZONE(type), type);
+				return refc;
+			}
+		}
+		refill_magazine(mag, vartype, type, flags);
+	}
+}
+
+/* spot_class_segment (private function)
+ * note: the lock of the array type must be held
+ *
+ * Spots an array segment in a page of the given size class, mapping
+ * such a page when every page of the class is full. The segments of a
+ * class page are chained like the ones of first-fit pages, so that
+ * walking the chain still works on them.
+ * Return value: the spotted segment
+ */
+array_obj_t * spot_class_segment(vartype_t vartype, type_t * type, uint8_t flags, int class){
+	page_desc_t ** head = &((type_runtime_t *)type->runtime)->class_pages[class][PG_FREE_LIST(flags)];
+	array_obj_t * segment = NULL;
+	while (segment == NULL){
+		if (*head == NULL){
+			page_desc_t * desc = map_pages(vartype, type, flags | PAGE_CLASS, 1);
+			prepare_page_slots(desc, ARRAY_CLASS_SIZE(class));
+			for (size_t i = 0; i < PG_SLOTS(desc); i++){
+				array_obj_t * seg = PG_SLOT(desc, i);
+				*seg = (array_obj_t){ NULL, (i + 1 < PG_SLOTS(desc)) ? PG_SLOT(desc, i + 1) : NULL, NULL, 0 };
+			}
+			push_free_page(type->runtime, desc);
+		}
+		page_desc_t * desc = *head;
+		if (claim_slots(desc, (void **)&segment, 1)) segment = (array_obj_t *)UNTAG_SLOT(segment);
+		if (desc->free_slots == 0) *head = (page_desc_t *)desc->next_free.p;
+	}
+	// the contents of a released segment are only reset by the collector
+	reset_array(segment);
+	return segment;
+}
+
+/* class_segment (page_desc_t pointer desc, pointer address)
+ *
+ * Finds the segment holding an address of a size class page.
+ * Return value: the segment
+ */
+array_obj_t * class_segment(page_desc_t * desc, void * address){
+	return PG_SLOT(desc, PG_SLOT_INDEX(desc, address));
+}
+
 void * spot_internal(vartype_t vartype, uint8_t flags, size_t array_bytes){
 	type_t * type = strip_variant(vartype);
+	if (!(type->flags & TYPE_ARRAY)) return spot_slot(vartype, type, flags);
+	type_runtime_t * runtime = get_runtime(type);
+	dirty_type(type);
+	pthread_mutex_lock(&runtime->lock);
+	int class = array_class(array_bytes + sizeof(array_obj_t));
+	if (class >= 0){
+		array_obj_t * segment = spot_class_segment(vartype, type, flags, class);
+		pthread_mutex_unlock(&runtime->lock);
+		return segment;
+	}
+	size_t bytes = array_bytes + sizeof(array_obj_t) + sizeof(page_desc_t);
+	if (bytes > compost_large_array_bytes){
+		// large arrays never share their pages, nor lengthen the chains of small ones
+		page_desc_t * desc = map_pages(vartype, type, flags | PAGE_LARGE, CEILDIV(bytes, page_size));
+		array_obj_t * segment = PG_REFC2(desc);
+		*segment = (array_obj_t){ NULL, NULL, NULL, 0 };
+		touch_page(desc);
+		pthread_mutex_unlock(&runtime->lock);
+		return segment;
+	}
 	page_desc_t * desc = type->page_list;
-	bool array_f = type->flags & TYPE_ARRAY;
 	while (true){
 		if (desc == NULL){
-			size_t contig_pages;
-			if (array_f){
-				size_t bytes = array_bytes + sizeof(array_obj_t) + sizeof(page_desc_t);
-				contig_pages = CEILDIV(bytes, page_size);
-			} else contig_pages = 1;
-
-			ptr_t page = new_random_page(contig_pages);
-			desc = (page_desc_t *)page.p;
-			prepare_page_desc(desc, vartype, type->page_list, contig_pages, flags);
-			size_t pg_limit = PG_LIMIT(desc, type);
-			for (ptr_t i = page; i.s < pg_limit; i.s += page_size){
-				set_page_descriptor(i, desc);
-			}
-
-			type->page_list = desc;
-			compost_pages += contig_pages;
+			desc = map_pages(vartype, type, flags, CEILDIV(bytes, page_size));
 		} else {
 			size_t pg_limit = PG_LIMIT(desc, type);
 			if (flags == PG_FLAGS(desc)){
 				for (array_obj_t * refc = PG_REFC2(desc); refc && PP(refc).s < pg_limit; ){
 					if (!is_obj_referenced(refc)){
-						if (refc->refc){
-							// reset_fields(compost_get_c_object(refc->refc), compost_type_of(refc->refc, true));
-							printf("\nCompost anomaly: is_obj_referenced() has not cleared the referenced count\n");
-							raise(SIGABRT);
-						}
-						if (array_f) grow_array(desc, refc);
-						if ((!array_f) || refc->capacity >= array_bytes){
-							if (array_f) shrink_array(desc, refc, array_bytes);
-							else reset_fields(compost_get_c_object(refc), type);
+						grow_array(desc, refc);
+						if (refc->capacity >= array_bytes){
+							shrink_array(desc, refc, array_bytes);
+							touch_page(desc);
+							pthread_mutex_unlock(&runtime->lock);
 							return refc;
-						} else if (array_f) refc->capacity = 0;
+						}
+						// too small, but now free and merged: nothing left to reset
+						refc->content_type = NULL;
+						refc->capacity = 0;
 					}
-					if (array_f) refc = refc->next;
-					else refc = (array_obj_t *)(PP(refc).s + type->paged_size);
+					refc = refc->next;
 				}
 			}
 			desc = PG_NEXT(desc);
@@ -85,6 +655,30 @@ void * compost_spot(vartype_t vartype){
 	return spot_internal(vartype, PAGE_BASIC, 0);
 }
 
+/* spot_n (vartype, 64bit n, pointer array out)
+ *
+ * Spots n instances of a type in one go: the slots are claimed with
+ * one lock of the type, and the missing ones are carved from a single
+ * block of new pages. Array types are spotted one by one.
+ * Return value: none, out receives the n reference counters
+ */
+void compost_spot_n(vartype_t vartype, size_t n, void ** out){
+	type_t * type = strip_variant(vartype);
+	if (type->flags & TYPE_ARRAY){
+		for (size_t i = 0; i < n; i++) out[i] = spot_internal(vartype, PAGE_BASIC, 0);
+		return;
+	}
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+	fill_slots(vartype, type, PAGE_BASIC, out, n);
+	pthread_mutex_unlock(&runtime->lock);
+	for (size_t i = 0; i < n; i++){
+		void ** refc = UNTAG_SLOT(out[i]);
+		if (out[i] == (void *)refc) reset_fields((void *)refc + GET_OFFSET_ZONE(type), type);
+		out[i] = refc;
+	}
+}
+
 void * compost_spot_dependent(void * destination, vartype_t vartype){
 	void ** new_spot;
 	uint8_t flags = compost_get_flags(destination);
@@ -96,6 +690,7 @@ void * compost_spot_dependent(void * destination, vartype_t vartype){
 }
 
 void reset_array(array_obj_t * array_obj){
+	if (array_obj->content_type == NULL) return;
 	type_t * type = compost_get_c_object(array_obj->content_type);
 	for (size_t i = 0; i < array_obj->capacity; i++){
 		void * c_object = compost_array_get(array_obj, i);
@@ -122,6 +717,7 @@ void shrink_array(page_desc_t * desc, array_obj_t * array_obj, size_t array_byte
 	if (excess > sizeof(array_obj_t)){
 		array_obj_t * new_array = (array_obj_t *)next;
 		new_array->refc = NULL;
+		new_array->content_type = NULL;
 		new_array->capacity = 0;
 		new_array->next = array_obj->next;
 		array_obj->next = new_array;
@@ -133,6 +729,7 @@ void * compost_spot_array_internal(type_t * type, size_t capacity, uint8_t flags
 	array_obj_t * array_obj = spot_internal((vartype_t){ .type = &get_root_page(type)->art }, flags, array_bytes);
 	array_obj->content_type = compost_get_obj(type);
 	array_obj->capacity = capacity;
+	if (!get_runtime(type)->in_arrays) get_runtime(type)->in_arrays = true;
 	return (void *)array_obj;
 }
 
@@ -150,6 +747,134 @@ void * compost_spot_array_dependent(void * destination, type_t * type, size_t ca
 	return new_spot;
 }
 
+/* resize_large_array (private function)
+ * note: the lock of the array type must be held
+ *
+ * Resizes the private mapping of a large array to fit array_bytes. If
+ * the system moves the mapping (its contents are not copied), the
+ * descriptor takes the place of the old one in the page list, and every
+ * pointer to the array follows it.
+ * Return value: the array, or NULL if the mapping could not be resized
+ */
+array_obj_t * resize_large_array(page_desc_t * desc, array_obj_t * array_obj, size_t array_bytes){
+	type_t * type = strip_variant(PG_TYPE2(desc));
+	size_t contig_len = (PG_RAW_LIMIT(desc) - PP(desc).s) / page_size;
+	size_t new_len = CEILDIV(sizeof(page_desc_t) + sizeof(array_obj_t) + array_bytes, page_size);
+	size_t old_limit = PG_RAW_LIMIT(desc);
+	if (new_len == contig_len) return array_obj;
+
+	pthread_mutex_lock(&pages_lock);
+	ptr_t page = remap_pages(desc, contig_len, new_len);
+	if (page.p == MAP_FAILED){
+		pthread_mutex_unlock(&pages_lock);
+		return NULL;
+	}
+	page_desc_t * moved = (page_desc_t *)page.p;
+	moved->flags_and_limit.s = (page.s + page_size * new_len) | PG_FLAGS(moved);
+	moved->bitmap = SP(PG_RAW_LIMIT(moved));
+	ptr_t i = (moved == desc) ? SP(old_limit) : page;
+	if (i.s < PG_RAW_LIMIT(moved)) set_page_descriptors(i, (PG_RAW_LIMIT(moved) - i.s) / page_size, moved);
+	// the pages which the mapping left
+	i = (moved == desc) ? SP(PG_RAW_LIMIT(moved)) : PP(desc);
+	for (; i.s < old_limit; i.s += page_size){
+		clear_page_descriptor(i);
+	}
+	compost_pages += new_len - contig_len;
+	pthread_mutex_unlock(&pages_lock);
+	if (moved == desc) return array_obj;
+
+	if (type->page_list == desc) type->page_list = moved;
+	else {
+		page_desc_t * prev = type->page_list;
+		while (PG_NEXT(prev) != desc) prev = PG_NEXT(prev);
+		prev->next = PP(moved);
+	}
+	// an incremental collection may resume from the moved page
+	if (gc_cursor.link == (page_desc_t **)&desc->next) gc_cursor.link = (page_desc_t **)&moved->next;
+	if (moved->young == young_generation){
+		pthread_mutex_lock(&young_lock);
+		page_desc_t ** link = &young_pages;
+		while (*link != desc) link = (page_desc_t **)&(*link)->next_young;
+		*link = moved;
+		pthread_mutex_unlock(&young_lock);
+	}
+	array_obj_t * moved_array = PG_REFC2(moved);
+	relocate(&array_obj->refc, &moved_array->refc, old_limit - PP(array_obj).s);
+	return moved_array;
+}
+
+/* array_resize (array_obj_t pointer array_obj, 64bit capacity)
+ *
+ * Changes the capacity of an array. The array grows in place when its
+ * segment (or the free segments following it) has room enough; otherwise
+ * its items are copied to a new segment, and every pointer to the array
+ * (owner field, referrers) or to its items is moved along. Large arrays
+ * resize their mapping instead, which the system may move without copying.
+ * Items beyond the new capacity are reset; new items are zeroed.
+ * Return value: the array, which may have moved
+ */
+void * compost_array_resize(array_obj_t * array_obj, size_t capacity){
+	type_t * type = compost_get_c_object(array_obj->content_type);
+	size_t item_size = type->object_size + type->offsets;
+	page_desc_t * desc = get_page_descriptor(array_obj);
+	type_runtime_t * runtime = get_runtime(strip_variant(PG_TYPE2(desc)));
+	pthread_mutex_lock(&runtime->lock);
+
+	for (size_t i = capacity; i < array_obj->capacity; i++){
+		reset_fields(ARRAY_GET(array_obj, item_size, i) + type->offsets, type);
+	}
+	size_t room;
+	if (PG_FLAGS(desc) & PAGE_CLASS) room = desc->stride - sizeof(array_obj_t);
+	else if (PG_FLAGS(desc) & PAGE_LARGE){
+		// pages added by the system are already zeroed
+		size_t dirty = PG_RAW_LIMIT(desc) - PP(ARRAY_GET(array_obj, item_size, array_obj->capacity)).s;
+		array_obj_t * resized = resize_large_array(desc, array_obj, capacity * item_size);
+		if (resized != NULL){
+			if (capacity > resized->capacity){
+				size_t added = (capacity - resized->capacity) * item_size;
+				zero(ARRAY_GET(resized, item_size, resized->capacity), (added < dirty) ? added : dirty, '\x00');
+			}
+			resized->capacity = capacity;
+			pthread_mutex_unlock(&runtime->lock);
+			return resized;
+		}
+		room = PG_RAW_LIMIT(desc) - PP(array_obj + 1).s;
+	} else {
+		while (array_obj->next != NULL && !is_obj_referenced(array_obj->next)){
+			reset_array(array_obj->next);
+			array_obj->next = array_obj->next->next;
+		}
+		size_t high_boundary = (array_obj->next == NULL) ? PG_RAW_LIMIT(desc) : PP(array_obj->next).s;
+		room = high_boundary - PP(array_obj + 1).s;
+	}
+	if (capacity * item_size <= room){
+		if (capacity > array_obj->capacity){
+			zero(ARRAY_GET(array_obj, item_size, array_obj->capacity), (capacity - array_obj->capacity) * item_size, '\x00');
+		}
+		if (!(PG_FLAGS(desc) & (PAGE_CLASS | PAGE_LARGE))) shrink_array(desc, array_obj, capacity * item_size);
+		array_obj->capacity = capacity;
+		pthread_mutex_unlock(&runtime->lock);
+		return array_obj;
+	}
+	pthread_mutex_unlock(&runtime->lock);
+
+	array_obj_t * moved = compost_spot_array_internal(type, capacity, PG_FLAGS(desc) & PAGE_DEPENDENT);
+	size_t kept = array_obj->capacity;
+	char * src = ARRAY_GET(array_obj, item_size, 0), * dst = ARRAY_GET(moved, item_size, 0);
+	memcpy(dst, src, kept * item_size);
+	if (!(PG_FLAGS(get_page_descriptor(moved)) & PAGE_LARGE)){
+		zero(dst + kept * item_size, (capacity - kept) * item_size, '\x00');
+	}
+	moved->refc = array_obj->refc;
+	relocate(&array_obj->refc, &moved->refc, sizeof(array_obj_t) + kept * item_size);
+	// nothing is left to reset in the old segment
+	array_obj->refc = NULL;
+	array_obj->content_type = NULL;
+	array_obj->capacity = 0;
+	release_slot(array_obj);
+	return moved;
+}
+
 /* array_get (array_obj_t pointer array_obj, 64bit index)
  * note: array_obj_t comprises the reference counter
  *
@@ -167,6 +892,278 @@ size_t compost_array_find(array_obj_t * array_obj, void * item){
 	return (PP(item).s - PP(array_obj).s) / (type->object_size + type->offsets);
 }
 
+/* next_slot (type_t pointer type, pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Return value: the slot (or array segment) following raw_refc in its
+ * page; for arrays, NULL after the last segment
+ */
+void * next_slot(type_t * type, void * raw_refc){
+	if (type->flags & TYPE_ARRAY) return ((array_obj_t *)raw_refc)->next;
+	else return raw_refc + type->paged_size;
+}
+
+/* mark_unit (private function)
+ *
+ * Finds the bit of a slot (or array segment) in the marks of its page:
+ * slot pages have one bit per slot, large pages a single one, and
+ * first-fit pages one per byte, since their segments start anywhere.
+ * Return value: the bit index; units receives the number of bits
+ */
+size_t mark_unit(page_desc_t * desc, void * raw_refc, size_t * units){
+	if (PG_HAS_SLOTS(desc)){
+		*units = PG_SLOTS(desc);
+		return PG_SLOT_INDEX(desc, raw_refc);
+	} else if (PG_FLAGS(desc) & PAGE_LARGE){
+		*units = 1;
+		return 0;
+	} else {
+		*units = PG_RAW_LIMIT(desc) - PP(PG_REFC2(desc)).s;
+		return PP(raw_refc).s - PP(PG_REFC2(desc)).s;
+	}
+}
+
+/* prepare_marks (page_desc_t pointer desc)
+ * note: this function is not meant to be used externally.
+ *
+ * Gives a page cleared marks for the current collection, unless it
+ * already has them. Parallel collections call this on every page
+ * before marking, so that marking only sets bits.
+ * Return value: the marks of the page
+ */
+uint64_t * prepare_marks(page_desc_t * desc){
+	uint64_t * marks = (uint64_t *)desc->marks.p;
+	if (marks != NULL && desc->mark_epoch == collection_epoch) return marks;
+	size_t units;
+	mark_unit(desc, PG_REFC2(desc), &units);
+	if (marks == NULL){
+		marks = malloc(CEILDIV(units, 64) * sizeof(uint64_t));
+		desc->marks = PP(marks);
+	}
+	for (size_t i = 0; i < CEILDIV(units, 64); i++) marks[i] = 0;
+	desc->mark_epoch = collection_epoch;
+	return marks;
+}
+
+/* mark_slot (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Sets the collector mark of a slot (or array segment). A page gets its
+ * marks the first time one of its slots is marked, and they are cleared
+ * the first time they are used in a new collection. The bit is set
+ * atomically, since several threads may mark the same page.
+ * Return value: true if the slot was already marked in this collection
+ */
+bool mark_slot(void * raw_refc){
+	page_desc_t * desc = get_page_descriptor(raw_refc);
+	uint64_t * marks = prepare_marks(desc);
+	size_t units, unit = mark_unit(desc, raw_refc, &units);
+	uint64_t bit = (uint64_t)1 << (unit % 64);
+	return __atomic_fetch_or(&marks[unit / 64], bit, __ATOMIC_RELAXED) & bit;
+}
+
+/* is_slot_marked (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Return value: true if the slot was marked in the current collection
+ */
+bool is_slot_marked(void * raw_refc){
+	page_desc_t * desc = get_page_descriptor(raw_refc);
+	if (desc->marks.p == NULL || desc->mark_epoch != collection_epoch) return false;
+	size_t units, unit = mark_unit(desc, raw_refc, &units);
+	return (((uint64_t *)desc->marks.p)[unit / 64] >> (unit % 64)) & 1;
+}
+
+/* is_slot_alive (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Tells whether the mark phase reached an object. Dependents which
+ * no field leads to (such as the arrays of the root types) live as
+ * long as their final owner.
+ * Return value: true if the object must survive the collection
+ */
+bool is_slot_alive(void ** raw_refc){
+	if (*raw_refc == NULL) return false;
+	if (is_slot_marked(raw_refc)) return true;
+	if (!(PG_FLAGS(get_page_descriptor(raw_refc)) & PAGE_DEPENDENT)) return false;
+	void ** owner = compost_get_final_obj(raw_refc);
+	return owner != raw_refc && *owner != NULL && is_slot_marked(owner);
+}
+
+/* unmark_slot (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Clears the collector mark of a slot (or array segment), if any.
+ * Return value: none
+ */
+void unmark_slot(void * raw_refc){
+	page_desc_t * desc = get_page_descriptor(raw_refc);
+	if (desc->marks.p == NULL || desc->mark_epoch != collection_epoch) return;
+	size_t units, unit = mark_unit(desc, raw_refc, &units);
+	__atomic_fetch_and(&((uint64_t *)desc->marks.p)[unit / 64], ~((uint64_t)1 << (unit % 64)), __ATOMIC_RELAXED);
+}
+
+/* touch_page (page_desc_t pointer desc)
+ * note: this function is not meant to be used externally.
+ *
+ * Lists a page in young_pages, once per generation: slots were spotted
+ * in it, or fields of its instances were set. compost_minor_collect
+ * only visits these pages, the others holding no new object and no new
+ * pointer to one.
+ * Return value: none
+ */
+void touch_page(page_desc_t * desc){
+	size_t generation = __atomic_load_n(&young_generation, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&desc->young, __ATOMIC_RELAXED) == generation) return;
+	pthread_mutex_lock(&young_lock);
+	if (desc->young != young_generation){
+		desc->young = young_generation;
+		desc->next_young = PP(young_pages);
+		young_pages = desc;
+	}
+	pthread_mutex_unlock(&young_lock);
+}
+
+/* dirty_type (type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Records that an instance of a type may have died: it was spotted,
+ * freed, unreferenced or detached. Collections leave the types which
+ * no dirty type leads to as they are, see select_types.
+ * Return value: none
+ */
+void dirty_type(type_t * type){
+	type_runtime_t * runtime = get_runtime(type);
+	if (!__atomic_load_n(&runtime->dirty, __ATOMIC_RELAXED)) __atomic_store_n(&runtime->dirty, true, __ATOMIC_RELAXED);
+}
+
+/* forget_young_pages ()
+ * note: this function is not meant to be used externally.
+ *
+ * Empties young_pages; called by the collections, before any page
+ * is released.
+ * Return value: none
+ */
+void forget_young_pages(){
+	pthread_mutex_lock(&young_lock);
+	young_pages = NULL;
+	__atomic_add_fetch(&young_generation, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&young_lock);
+}
+
+/* unlink_dead_page (page_desc_t pointer desc, type_t pointer type)
+ * note: this function is not meant to be used externally.
+ * note: the marking of compost_minor_collect must be over.
+ *
+ * Calls unlink_fields on the dead instances (or array segments) of a
+ * young page, freed slots included, and clears their marks: sweep_page
+ * then zeroes them without looking at other objects. This must be done
+ * on every young page before any of them is swept.
+ * Return value: none
+ */
+void unlink_dead_page(page_desc_t * desc, type_t * type){
+	size_t pg_limit = PG_LIMIT(desc, type);
+	if (!(type->flags & TYPE_ARRAY)){
+		size_t fresh_limit = PP(PG_SLOT(desc, desc->fresh)).s;
+		if (fresh_limit < pg_limit) pg_limit = fresh_limit;
+	}
+	for (void ** refc = PG_REFC2(desc); refc && PP(refc).s < pg_limit; refc = next_slot(type, refc)){
+		if (is_slot_alive(refc)) continue;
+		if (type->flags & TYPE_ARRAY){
+			array_obj_t * array_obj = (array_obj_t *)refc;
+			if (array_obj->content_type != NULL){
+				type_t * content_type = compost_get_c_object(array_obj->content_type);
+				size_t item_size = content_type->object_size + content_type->offsets;
+				for (size_t i = 0; i < array_obj->capacity; i++){
+					unlink_fields(ARRAY_GET(array_obj, item_size, i) + content_type->offsets, content_type);
+				}
+			}
+		} else unlink_fields(compost_get_c_object(refc), type);
+		unmark_slot(refc);
+	}
+}
+
+/* prune_referrers (pointer refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Detaches the dead referrers from the chain of a live object; this
+ * must be done before any dead object is zeroed.
+ * Return value: none
+ */
+void prune_referrers(void ** refc){
+	while (*refc != NULL){
+		void ** prev_owner = get_previous_owner(*refc);
+		if (!is_slot_alive(find_raw_refc(*refc))){
+			*(void **)*refc = NULL;
+			unlink_referrer(refc);
+		} else refc = prev_owner;
+	}
+}
+
+/* prune_page (page_desc_t pointer desc, type_t pointer type)
+ * note: this function is not meant to be used externally.
+ *
+ * Calls prune_referrers on every live independent instance of a page.
+ * Return value: the number of slots visited
+ */
+size_t prune_page(page_desc_t * desc, type_t * type){
+	size_t n = 0;
+	if (PG_FLAGS(desc) & PAGE_DEPENDENT) return 1;
+	size_t pg_limit = PG_LIMIT(desc, type);
+	for (void ** refc = PG_REFC2(desc); refc && PP(refc).s < pg_limit; refc = next_slot(type, refc), n++){
+		if (*refc != NULL && *refc != FAKE_DEPENDENT(refc) && is_slot_marked(refc)) prune_referrers(refc);
+	}
+	return n;
+}
+
+void prune_page_list(page_desc_t * desc, type_t * type){
+	for (; desc != NULL; desc = PG_NEXT(desc)) prune_page(desc, type);
+}
+
+/* sweep_fields (pointer c_object, type_t pointer type, boolean marked)
+ * note: this function is not meant to be used externally.
+ *
+ * Zeroes a dead instance. Unless the mark phase reached it, its
+ * referrers and its dependents are all dead, and the referents it
+ * points to have already been pruned: only its malloc'd fields
+ * need a look before the zeroing.
+ * Return value: none
+ */
+void sweep_fields(void * c_object, type_t * type, bool marked){
+	if (marked) return reset_fields(c_object, type);
+	if (type->flags & TYPE_ROOT) free_runtime(c_object);
+	type_runtime_t * runtime = get_reset_plan(type);
+	if (runtime->reset_steps <= RESET_PLAN_SIZE){
+		for (size_t s = 0; s < runtime->reset_steps; s++){
+			reset_step_t * step = &runtime->reset_plan[s];
+			if (step->flags & FIBF_MALLOC) free(*(void **)(c_object + step->offset));
+		}
+	} else for (size_t i = 0; i < type->object_size; i++){
+		if (GET_FIB(type, i)->flags & FIBF_MALLOC) free(*(void **)(c_object + i));
+	}
+	memset(c_object, 0, type->object_size);
+}
+
+/* sweep_array (array_obj_t pointer array_obj)
+ * note: this function is not meant to be used externally.
+ *
+ * Same as sweep_fields, for every item of a dead array segment.
+ * Return value: none
+ */
+void sweep_array(array_obj_t * array_obj){
+	bool marked = is_slot_marked(array_obj);
+	if (array_obj->content_type != NULL){
+		type_t * type = compost_get_c_object(array_obj->content_type);
+		size_t item_size = type->object_size + type->offsets;
+		for (size_t i = 0; i < array_obj->capacity; i++){
+			sweep_fields(ARRAY_GET(array_obj, item_size, i) + type->offsets, type, marked);
+		}
+	}
+	array_obj->refc = NULL;
+	array_obj->content_type = NULL;
+	array_obj->capacity = 0;
+}
+
 /* page_occupied_slots (obj pointer first_instance, type_t pointer type)
  * note: this function is not meant to be used externally.
  *
@@ -176,62 +1173,366 @@ size_t compost_array_find(array_obj_t * array_obj, void * item){
  */
 size_t page_occupied_slots(size_t pg_limit, uint8_t flags, void * first_instance, type_t * type){
 	size_t n = 0;
-	for (void * refc = first_instance; refc && PP(refc).s < pg_limit;){
+	for (void * refc = first_instance; refc && PP(refc).s < pg_limit; refc = next_slot(type, refc)){
 		n += is_obj_referenced(refc);
-		if (type->flags & TYPE_ARRAY) refc = ((array_obj_t *)refc)->next;
-		else refc += type->paged_size;
 	}
 	return n;
 }
 
-/* update_page_list (page_list object pointer pl_obj, type_t pointer type, boolean should_delete)
+/* sweep_page (page_desc_t pointer desc, type_t pointer type, mark_stack_t pointer deferred)
  * note: this function is not meant to be used externally.
- * note: is called two times by the gc, only the second time pages are deleted
+ * note: the mark phase and prune_page_list must have run on every type.
  *
- * This function unmaps unused pages. If a page is to be unmapped, it will
- * remove references to values in the page first.
- * Return value: this page-list block if it was not empty, or the next block
- * if it was empty; this way the list is updated from the last block to the
- * first.
+ * Sweeps the instances of a page which the mark phase did not reach.
+ * Slots above the high-water mark of the page are not visited. Dead
+ * instances which were marked need a full reset, which touches other
+ * types: if deferred is not NULL, they are pushed there and left in place.
+ * Return value: the number of live (or deferred) instances of the page
  */
-page_desc_t * update_page_list(page_desc_t * desc, type_t * type, bool should_delete){
-	if (desc != NULL){
-		page_desc_t * next_desc = update_page_list(PG_NEXT(desc), type, should_delete);
-		desc->next.p = (ptr_t *)next_desc;
-		void * first_instance = PG_REFC2(desc);
-		size_t pg_limit = PG_LIMIT(desc, type);
-		uint8_t flags = PG_FLAGS(desc);
+size_t sweep_page(page_desc_t * desc, type_t * type, mark_stack_t * deferred){
+	void * first_instance = PG_REFC2(desc);
+	size_t pg_limit = PG_LIMIT(desc, type);
+	uint8_t flags = PG_FLAGS(desc);
+	size_t live = 0;
 
-		if (should_delete && page_occupied_slots(pg_limit, flags, first_instance, type) == 0){
-			size_t bytes = PG_RAW_LIMIT(desc) - PP(desc).s;
-			compost_pages -= bytes / page_size;
-			munmap(desc, bytes);
-			desc = next_desc;
-		} else {
-			// first gc iteration
-			// goal: detach all dependent objects
-
-			for (array_obj_t * refc = first_instance; refc && PP(refc).s < pg_limit; ){
-				bool unreferenced = !is_obj_referenced(refc);
-				if (type->flags & TYPE_ARRAY){
-					if (unreferenced){
-						for (size_t i = 0; i < refc->capacity; i++){
-							void * c_object = compost_array_get(refc, i);
-							type_t * content_type = compost_get_c_object(refc->content_type);
-							reset_fields(c_object + content_type->offsets, content_type);
-						}
-					}
-					refc = refc->next;
-				} else {
-					if (unreferenced) reset_fields(compost_get_c_object(refc), type);
-					refc = (array_obj_t *)(PP(refc).s + type->paged_size);
-				}
+	if (type->flags & TYPE_ARRAY){
+		for (array_obj_t * refc = first_instance; refc && PP(refc).s < pg_limit; refc = refc->next){
+			if (is_slot_alive(&refc->refc)){
+				live++;
+				continue;
+			} else if (deferred != NULL && is_slot_marked(refc)){
+				push_stack(deferred, &refc->refc);
+				live++;
+				continue;
+			}
+			sweep_array(refc);
+			if (flags & PAGE_CLASS) release_slot(refc);
+			else while (refc->next != NULL && !is_slot_alive(&refc->next->refc) && !(deferred != NULL && is_slot_marked(refc->next))){
+				// coalesce the free neighbours of first-fit segments
+				sweep_array(refc->next);
+				refc->next = refc->next->next;
+			}
+		}
+	} else {
+		uint64_t * bitmap = PG_BITMAP(desc);
+		size_t slots = PG_SLOTS(desc), released = 0;
+		if (desc->fresh < slots) slots = desc->fresh;
+		// slots released by the program keep their fields until they are spotted
+		bool unswept = desc->unswept;
+		desc->unswept = false;
+		for (size_t i = 0; i < slots; i++){
+			void ** refc = PG_SLOT(desc, i);
+			bool marked, claimed = (bitmap[i / 64] >> (i % 64)) & 1;
+			// free slots were swept already, unless they were protected again
+			if (!claimed && *refc == NULL && !unswept) continue;
+			if (is_slot_alive(refc)){
+				live++;
+				continue;
+			} else if ((marked = is_slot_marked(refc)) && deferred != NULL){
+				push_stack(deferred, refc);
+				live++;
+				continue;
 			}
+			// claimed free slots are swept too: they may be kept in magazines
+			sweep_fields(compost_get_c_object(refc), type, marked);
+			*refc = NULL;
+			released += claimed;
 		}
+		if (released) release_swept_slots(desc, type, slots, deferred);
+	}
+	return live;
+}
+
+/* release_swept_slots (page_desc_t pointer desc, type_t pointer type, 64bit slots, mark_stack_t pointer deferred)
+ * note: this function is not meant to be used externally.
+ *
+ * Clears the occupancy bits of the slots which sweep_page has just swept,
+ * among the first slots of the page, under a single lock of the type runtime.
+ * Sweeping fields may free other slots, so this cannot be done along the way.
+ * Return value: none
+ */
+void release_swept_slots(page_desc_t * desc, type_t * type, size_t slots, mark_stack_t * deferred){
+	uint64_t * bitmap = PG_BITMAP(desc);
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+	// only the releases which sweeping fields caused need another sweep
+	bool unswept = desc->unswept;
+	for (size_t w = 0; w < CEILDIV(slots, 64); w++){
+		for (uint64_t claimed = bitmap[w]; claimed; claimed &= claimed - 1){
+			size_t i = w * 64 + __builtin_ctzll(claimed);
+			if (i >= slots) break;
+			void ** refc = PG_SLOT(desc, i);
+			if (*refc == NULL && !(deferred != NULL && is_slot_marked(refc))) release_slot_locked(desc, type, refc);
+		}
+	}
+	desc->unswept = unswept;
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* update_page_list (page_desc_t pointer desc, type_t pointer type, boolean should_delete, mark_stack_t pointer deferred)
+ * note: this function is not meant to be used externally.
+ *
+ * This function calls sweep_page on every page of a list and detaches
+ * unused pages, which are queued until release_empty_pages unmaps them:
+ * sweeping the instances of another page may still need to read them.
+ * The list is walked in a loop, whatever its length.
+ * Return value: the first page of the list which was not detached
+ */
+page_desc_t * update_page_list(page_desc_t * desc, type_t * type, bool should_delete, mark_stack_t * deferred){
+	page_desc_t ** link = &desc;
+	while (*link != NULL){
+		page_desc_t * page = *link;
+		if (sweep_page(page, type, deferred) == 0 && should_delete){
+			*link = PG_NEXT(page);
+			queue_empty_page(page);
+		} else link = (page_desc_t **)&page->next;
 	}
 	return desc;
 }
 
+/* queue_empty_page (page_desc_t pointer desc)
+ * note: this function is not meant to be used externally.
+ *
+ * Queues a page which has been detached from its page list,
+ * so that release_empty_pages unmaps it.
+ * Return value: none
+ */
+void queue_empty_page(page_desc_t * desc){
+	pthread_mutex_lock(&pages_lock);
+	desc->next = PP(empty_pages);
+	empty_pages = desc;
+	pthread_mutex_unlock(&pages_lock);
+}
+
+/* sweep_deferred (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Resets an instance (or array segment) which update_page_list deferred.
+ * Return value: none
+ */
+void sweep_deferred(void ** raw_refc){
+	type_t * type = strip_variant(PG_TYPE2(get_page_descriptor(raw_refc)));
+	if (type->flags & TYPE_ARRAY) sweep_array((array_obj_t *)raw_refc);
+	else {
+		sweep_fields(compost_get_c_object(raw_refc), type, true);
+		*raw_refc = NULL;
+	}
+	release_slot(raw_refc);
+}
+
+/* retain_page (page_desc_t pointer desc, 64bit contig_len)
+ * note: this function is not meant to be used externally.
+ *
+ * Keeps an empty page (or run of pages) mapped and registered for its
+ * type to reuse, or for any type once the type has enough of them; its
+ * memory is discarded, so its descriptor must not be read anymore.
+ * Return value: none
+ */
+void retain_page(page_desc_t * desc, size_t contig_len){
+	type_runtime_t * runtime = get_runtime(strip_variant(PG_TYPE2(desc)));
+	retained_page_t * node = malloc(sizeof(retained_page_t));
+	*node = (retained_page_t){ NULL, desc, contig_len };
+	discard_pages(desc, contig_len);
+	pthread_mutex_lock(&runtime->lock);
+	if (runtime->growth == GROWTH_ADAPTIVE && runtime->growth_next > 1) runtime->growth_next /= 2;
+	pthread_mutex_lock(&pages_lock);
+	if (runtime->retained_count + contig_len <= compost_retain_type_pages){
+		node->next = runtime->retained;
+		runtime->retained = node;
+		runtime->retained_count += contig_len;
+	} else {
+		node->next = retained_pages;
+		retained_pages = node;
+		retained_global += contig_len;
+	}
+	compost_retained_pages += contig_len;
+	compost_pages -= contig_len;
+	pthread_mutex_unlock(&pages_lock);
+	pthread_mutex_unlock(&runtime->lock);
+}
+
+/* trim_retained_pages (64bit low)
+ * note: this function is not meant to be used externally.
+ * note: pages_lock must be held
+ *
+ * Unmaps pages of the global pool until it holds at most low pages.
+ * Return value: none
+ */
+void trim_retained_pages(size_t low){
+	while (retained_global > low && retained_pages != NULL){
+		retained_page_t * node = retained_pages;
+		retained_pages = node->next;
+		retained_global -= node->contig_len;
+		compost_retained_pages -= node->contig_len;
+		release_pages(node->page, node->contig_len);
+		free(node);
+	}
+}
+
+/* release_empty_pages ()
+ * note: this function is not meant to be used externally.
+ *
+ * Retains the pages which update_page_list detached; large array
+ * mappings are unmapped. The global pool is trimmed down to
+ * compost_retain_low once it holds more than compost_retain_pages.
+ * Return value: none
+ */
+void release_empty_pages(){
+	while (empty_pages != NULL){
+		page_desc_t * desc = empty_pages;
+		empty_pages = PG_NEXT(desc);
+		size_t contig_len = (PG_RAW_LIMIT(desc) - PP(desc).s) / page_size;
+		free(desc->marks.p);
+		if (PG_FLAGS(desc) & PAGE_LARGE){
+			pthread_mutex_lock(&pages_lock);
+			compost_pages -= contig_len;
+			release_pages(desc, contig_len);
+			pthread_mutex_unlock(&pages_lock);
+		} else retain_page(desc, contig_len);
+	}
+	pthread_mutex_lock(&pages_lock);
+	if (retained_global > compost_retain_pages) trim_retained_pages(compost_retain_low);
+	pthread_mutex_unlock(&pages_lock);
+}
+
+/* compact_page_t (private structure)
+ *
+ * A page of the type being compacted: its live instances, and whether
+ * one of them cannot move.
+ */
+typedef struct compact_page {
+	page_desc_t * desc;
+	size_t live;
+	bool pinned;
+} compact_page_t;
+
+// instances only move between pages of the same variant and flags
+bool same_page_kind(page_desc_t * a, page_desc_t * b){
+	return a->vartype.s == b->vartype.s && PG_FLAGS(a) == PG_FLAGS(b);
+}
+
+// pages of the same kind together, the densest first
+int compare_compact_pages(const void * a, const void * b){
+	const compact_page_t * pa = a, * pb = b;
+	if (pa->desc->vartype.s != pb->desc->vartype.s) return (pa->desc->vartype.s < pb->desc->vartype.s) ? -1 : 1;
+	if (PG_FLAGS(pa->desc) != PG_FLAGS(pb->desc)) return (PG_FLAGS(pa->desc) < PG_FLAGS(pb->desc)) ? -1 : 1;
+	return (pa->live > pb->live) ? -1 : (pa->live < pb->live);
+}
+
+int compare_addresses(const void * a, const void * b){
+	size_t pa = *(size_t *)a, pb = *(size_t *)b;
+	return (pa > pb) - (pa < pb);
+}
+
+/* evacuate_page (private function)
+ * note: the lock of the type must be held
+ *
+ * Moves the live instances of a page into the free slots of another
+ * one of the same kind: the referrers, the owner and the dependents of
+ * each instance follow it (see relocate), and so does its mark.
+ * Return value: true once the source page is empty, false when the
+ * destination is full
+ */
+bool evacuate_page(page_desc_t * from, page_desc_t * to, type_t * type){
+	size_t fresh_limit = PP(PG_SLOT(from, from->fresh)).s;
+	size_t pg_limit = PG_LIMIT(from, type);
+	if (fresh_limit < pg_limit) pg_limit = fresh_limit;
+	for (void ** refc = PG_REFC2(from); PP(refc).s < pg_limit; refc = (void *)refc + type->paged_size){
+		if (*refc == NULL) continue;
+		void ** slot;
+		if (claim_slots(to, (void **)&slot, 1) == 0) return false;
+		slot = UNTAG_SLOT(slot);
+		memcpy(slot, refc, type->paged_size);
+		relocate(refc, slot, type->paged_size);
+		if (is_slot_marked(refc)) mark_slot(slot);
+		unmark_slot(refc);
+		// the fields now belong to the new instance: nothing to unlink
+		memset(refc, 0, type->paged_size);
+		release_slot_locked(from, type, refc);
+	}
+	return true;
+}
+
+/* compact (type_t pointer type, 64bit target_occupancy)
+ * note: this function is indirectly responsible for page unmaps.
+ * note: other threads must not use compost while it runs.
+ *
+ * Moves the instances of the pages which are less than target_occupancy
+ * percent full into the denser pages of the type, then releases the
+ * emptied pages like a collection does. Pages holding a protected object
+ * are never evacuated, since the program may hold pointers to it: other
+ * objects are moved, so the program must only reach them through
+ * protected ones. Array types are not compacted.
+ * Return value: the number of pages (or runs of pages) released
+ */
+size_t compost_compact(type_t * type, size_t target_occupancy){
+	if (type->flags & (TYPE_ARRAY | TYPE_ROOT)) return 0;
+	abandon_gc_step();
+	type_runtime_t * runtime = get_runtime(type);
+	pthread_mutex_lock(&runtime->lock);
+
+	size_t n = 0;
+	for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)) n++;
+	compact_page_t * pages = malloc(n * sizeof(compact_page_t));
+	n = 0;
+	for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)){
+		if (!PG_HAS_SLOTS(desc)) continue;
+		compact_page_t * page = &pages[n++];
+		*page = (compact_page_t){ desc, 0, false };
+		for (size_t i = 0; i < desc->fresh && i < PG_SLOTS(desc); i++){
+			void ** refc = PG_SLOT(desc, i);
+			if (*refc == NULL) continue;
+			page->live++;
+			if (*refc == FAKE_DEPENDENT(refc)) page->pinned = true;
+		}
+	}
+	qsort(pages, n, sizeof(compact_page_t), compare_compact_pages);
+
+	// the sparsest pages of each kind are evacuated into the densest ones
+	size_t * evacuated = malloc(n * sizeof(size_t)), released = 0;
+	for (size_t group = 0, end; group < n; group = end){
+		for (end = group; end < n && same_page_kind(pages[group].desc, pages[end].desc); end++);
+		size_t to = group;
+		for (size_t from = end - 1; from > to; from--){
+			compact_page_t * source = &pages[from];
+			if (source->live * 100 >= target_occupancy * PG_SLOTS(source->desc)) break;
+			if (source->pinned) continue;
+			while (!evacuate_page(source->desc, pages[to].desc, type) && ++to < from);
+			if (to == from) break;
+			evacuated[released++] = PP(source->desc).s;
+		}
+	}
+
+	// detach the evacuated pages, and forget them in young_pages
+	qsort(evacuated, released, sizeof(size_t), compare_addresses);
+	page_desc_t ** link = (page_desc_t **)&type->page_list;
+	while (*link != NULL){
+		page_desc_t * desc = *link;
+		if (!bsearch(&desc, evacuated, released, sizeof(size_t), compare_addresses)){
+			link = (page_desc_t **)&desc->next;
+			continue;
+		}
+		*link = PG_NEXT(desc);
+		if (desc->young == young_generation){
+			pthread_mutex_lock(&young_lock);
+			page_desc_t ** young = &young_pages;
+			while (*young != desc) young = (page_desc_t **)&(*young)->next_young;
+			*young = (page_desc_t *)desc->next_young.p;
+			pthread_mutex_unlock(&young_lock);
+		}
+		queue_empty_page(desc);
+	}
+	free(evacuated);
+	free(pages);
+	pthread_mutex_unlock(&runtime->lock);
+
+	// the magazines may hold slots of the released pages
+	invalidate_magazines();
+	release_empty_pages();
+	rebuild_free_pages(type);
+	return released;
+}
+
 root_page_t * get_root_page(void * obj){
 	page_desc_t * desc = get_page_descriptor(obj); // getting any type
 	desc = get_page_descriptor(PG_TYPE2(desc).obj); // getting the root type
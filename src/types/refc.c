@@ -19,11 +19,20 @@
 
 #include "types/refc.h"
 
+size_t compost_gc_threads = 1;
+gc_cursor_t gc_cursor = { .phase = GC_IDLE };
+pthread_mutex_t gc_barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+// writers first, otherwise a busy mutator would never let a slice run
+pthread_rwlock_t gc_world_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+collector_t gc_collector = { .running = false };
+root_page_t * young_context = NULL;
+
 void ** find_raw_refc(void * address){
 	page_desc_t * desc = get_page_descriptor(address);
 	type_t * type = strip_variant(PG_TYPE2(desc));
 	if (type->flags & TYPE_ARRAY){
 		array_obj_t * array_obj = PG_REFC2(desc), * next_ap;
+		if (PG_FLAGS(desc) & PAGE_CLASS) return &class_segment(desc, address)->refc;
 		while ((next_ap = array_obj->next) != NULL){
 			if (address < (void *)next_ap) break;
 			else array_obj = next_ap;
@@ -51,6 +60,7 @@ bool compost_protect(void * obj){
 	void ** refc = find_refc(obj, NULL);
 	bool result = (*refc == NULL);
 	if (result) *refc = FAKE_DEPENDENT(refc);
+	gc_barrier(refc);
 	return result;
 }
 
@@ -61,11 +71,22 @@ bool is_obj_protected(void * obj){
 
 void compost_unprotect(void * obj){
 	void ** refc = find_refc(obj, NULL);
-	if (*refc == FAKE_DEPENDENT(refc)) *refc = NULL;
+	if (*refc == FAKE_DEPENDENT(refc)){
+		gc_barrier(refc);
+		*refc = NULL;
+		free_slot(refc);
+	}
 }
 
+/* is_obj_referenced (pointer obj)
+ *
+ * Tells whether an object has referrers, as last checked by the
+ * collector: referrers which died since are only detached by the next
+ * collection. This costs one load (plus one per owner, for dependents).
+ * Return value: true if the object is referenced
+ */
 bool is_obj_referenced(void * obj){
-	return *find_refc(obj, NULL) != NULL;
+	return *(void **)compost_get_final_obj(obj) != NULL;
 }
 
 /* type_instances (type_t pointer type)
@@ -82,39 +103,642 @@ int compost_type_instances(type_t * type){
 	return n;
 }
 
+void push_stack(mark_stack_t * stack, void ** raw_refc){
+	if (stack->len == stack->cap){
+		stack->cap = stack->cap ? stack->cap * 2 : MARK_STACK_MIN;
+		stack->refcs = realloc(stack->refcs, stack->cap * sizeof(void *));
+	}
+	stack->refcs[stack->len++] = raw_refc;
+}
+
+/* push_mark (mark_stack_t pointer stack, pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Marks an object, and pushes it on the mark stack if it was not
+ * marked yet, so that each object is traced once per collection.
+ * Return value: none
+ */
+void push_mark(mark_stack_t * stack, void ** raw_refc){
+	if (!mark_slot(raw_refc)) push_stack(stack, raw_refc);
+}
+
+// returns the number of instances traced
+size_t trace_object(void ** raw_refc, mark_stack_t * stack){
+	type_t * type = strip_variant(PG_TYPE2(get_page_descriptor(raw_refc)));
+	if (type->flags & TYPE_ARRAY){
+		array_obj_t * array_obj = (array_obj_t *)raw_refc;
+		if (array_obj->content_type == NULL) return 1;
+		type = compost_get_c_object(array_obj->content_type);
+		type_runtime_t * runtime = get_reset_plan(type);
+		if (!runtime->in_arrays) runtime->in_arrays = true;
+		if (runtime->reset_steps == 0) return 1;
+		size_t item_size = type->object_size + type->offsets;
+		for (size_t i = 0; i < array_obj->capacity; i++){
+			trace_fields(ARRAY_GET(array_obj, item_size, i) + type->offsets, type, stack);
+		}
+		return array_obj->capacity + 1;
+	} else trace_fields(compost_get_c_object(raw_refc), type, stack);
+	return 1;
+}
+
+// pushes the protected instances of a page, returns the number of slots visited
+size_t push_page_roots(page_desc_t * desc, type_t * type, mark_stack_t * stack){
+	size_t pg_limit = PG_LIMIT(desc, type), n = 0;
+	for (void ** refc = PG_REFC2(desc); refc && PP(refc).s < pg_limit; refc = next_slot(type, refc), n++){
+		if (*refc == FAKE_DEPENDENT(refc)) push_mark(stack, refc);
+	}
+	return n;
+}
+
+void push_roots(type_t * type, mark_stack_t * stack){
+	for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)) push_page_roots(desc, type, stack);
+}
+
+// moves the n objects on top of a stack to another one
+void move_marks(mark_stack_t * to, mark_stack_t * from, size_t n){
+	for (size_t i = from->len - n; i < from->len; i++) push_stack(to, from->refcs[i]);
+	__atomic_store_n(&from->len, from->len - n, __ATOMIC_RELEASE);
+}
+
+/* steal_marks (private function)
+ *
+ * Called by a worker whose stack is empty: takes the objects shared by
+ * any worker, waiting until some are shared or every worker is idle.
+ * A worker takes its own shared objects back before becoming idle, so
+ * that no object is left shared once all of them are.
+ * Return value: false if the mark phase is over
+ */
+bool steal_marks(gc_worker_t * worker){
+	gc_t * gc = worker->gc;
+	size_t self = worker - gc->workers;
+	pthread_mutex_lock(&worker->lock);
+	move_marks(&worker->stack, &worker->shared, worker->shared.len);
+	pthread_mutex_unlock(&worker->lock);
+	if (worker->stack.len) return true;
+
+	__atomic_add_fetch(&gc->idle, 1, __ATOMIC_ACQ_REL);
+	for (;;){
+		for (size_t k = 1; k < gc->n_workers; k++){
+			gc_worker_t * victim = &gc->workers[(self + k) % gc->n_workers];
+			if (__atomic_load_n(&victim->shared.len, __ATOMIC_ACQUIRE) == 0) continue;
+			__atomic_sub_fetch(&gc->idle, 1, __ATOMIC_ACQ_REL);
+			pthread_mutex_lock(&victim->lock);
+			move_marks(&worker->stack, &victim->shared, victim->shared.len);
+			pthread_mutex_unlock(&victim->lock);
+			if (worker->stack.len) return true;
+			__atomic_add_fetch(&gc->idle, 1, __ATOMIC_ACQ_REL);
+		}
+		if (__atomic_load_n(&gc->idle, __ATOMIC_ACQUIRE) == gc->n_workers) return false;
+		sched_yield();
+	}
+}
+
+/* drain_marks (private function)
+ *
+ * Traces the objects of the stack of a worker until the mark phase is
+ * over. While other workers run, half of a big stack is shared with them.
+ * Return value: none
+ */
+void drain_marks(gc_worker_t * worker){
+	gc_t * gc = worker->gc;
+	mark_stack_t * stack = &worker->stack;
+	do while (stack->len){
+		trace_object(stack->refcs[--stack->len], stack);
+		if (gc->n_workers > 1 && stack->len > MARK_SHARE && __atomic_load_n(&worker->shared.len, __ATOMIC_ACQUIRE) == 0){
+			pthread_mutex_lock(&worker->lock);
+			move_marks(&worker->shared, stack, stack->len / 2);
+			pthread_mutex_unlock(&worker->lock);
+		}
+	} while (gc->n_workers > 1 && steal_marks(worker));
+}
+
+/* collect_field_type (private function)
+ *
+ * Selects the type which a dependent or referencing field leads to.
+ * Return value: false if the field leads to no type at all
+ */
+bool collect_field_type(field_info_b_t * fib, bool * changed, bool * arrays){
+	if (fib->field_vartype.obj == NULL) return false;
+	type_t * type = strip_variant(fib->field_vartype);
+	type_runtime_t * runtime = get_runtime(type);
+	if (!runtime->collect) *changed = runtime->collect = true;
+	if (type->flags & TYPE_ARRAY) *arrays = true;
+	return true;
+}
+
+/* select_types (private function)
+ *
+ * Tells which types of a collection may have dead instances: the dirty
+ * types, and the types their fields lead to, until no more type is
+ * found. The fields of arrays lead to the types of their items, which
+ * may be any type spotted as such. Only the selected types get pruned
+ * and swept; they are all selected if a field has no type.
+ * Return value: none
+ */
+void select_types(type_t ** types, size_t n_types){
+	bool changed = true, arrays = false, all = false;
+	for (size_t i = 0; i < n_types; i++){
+		type_runtime_t * runtime = get_runtime(types[i]);
+		runtime->collect = runtime->dirty;
+	}
+	while (changed && !all){
+		changed = false;
+		for (size_t i = 0; i < n_types && !all; i++){
+			type_t * type = types[i];
+			type_runtime_t * runtime = get_reset_plan(type);
+			if (!runtime->collect) continue;
+			if (runtime->reset_steps <= RESET_PLAN_SIZE){
+				for (size_t s = 0; s < runtime->reset_steps && !all; s++){
+					reset_step_t * step = &runtime->reset_plan[s];
+					if (TRACED_FIELD(step->flags)) all = !collect_field_type(GET_FIB(type, step->offset), &changed, &arrays);
+				}
+			} else for (size_t f = 0; f < type->object_size && !all; f++){
+				field_info_b_t * fib = GET_FIB(type, f);
+				if (TRACED_FIELD(fib->flags)) all = !collect_field_type(fib, &changed, &arrays);
+			}
+		}
+		if (arrays) for (size_t i = 0; i < n_types; i++){
+			type_runtime_t * runtime = get_runtime(types[i]);
+			if (runtime->in_arrays && !runtime->collect) changed = runtime->collect = true;
+		}
+	}
+	if (all) for (size_t i = 0; i < n_types; i++) get_runtime(types[i])->collect = true;
+}
+
+/* sweep_type (type_t pointer type, mark_stack_t pointer deferred)
+ * note: this function is not meant to be used externally.
+ *
+ * Calls update_page_list on a type selected by select_types, which
+ * is clean again once swept.
+ * Return value: none
+ */
+void sweep_type(type_t * type, mark_stack_t * deferred){
+	type_runtime_t * runtime = get_runtime(type);
+	if (!runtime->collect) return;
+	runtime->dirty = false;
+	type->page_list = update_page_list(type->page_list, type, true, deferred);
+}
+
+/* run_gc_worker (private function)
+ *
+ * Runs the phases of a collection which are split among its workers:
+ * marking from the roots, pruning the referrers of the live objects,
+ * then sweeping every type but the root type. Each phase hands out the
+ * types one at a time, and waits for the previous one to be over. The
+ * marked instances which the sweep defers are left on the stack of
+ * the worker.
+ * Return value: NULL
+ */
+void * run_gc_worker(gc_worker_t * worker){
+	gc_t * gc = worker->gc;
+	size_t i;
+	pthread_mutex_lock(&gc->start_lock);
+	pthread_mutex_unlock(&gc->start_lock);
+
+	while ((i = __atomic_fetch_add(&gc->next_root, 1, __ATOMIC_RELAXED)) < gc->n_types){
+		push_roots(gc->types[i], &worker->stack);
+	}
+	drain_marks(worker);
+	pthread_barrier_wait(&gc->barrier);
+
+	while ((i = __atomic_fetch_add(&gc->next_prune, 1, __ATOMIC_RELAXED)) < gc->n_types){
+		if (get_runtime(gc->types[i])->collect) prune_page_list(gc->types[i]->page_list, gc->types[i]);
+	}
+	pthread_barrier_wait(&gc->barrier);
+
+	// the root type is swept last: it resets the dead types
+	while (gc->sweep && (i = __atomic_fetch_add(&gc->next_sweep, 1, __ATOMIC_RELAXED)) < gc->n_types){
+		type_t * type = gc->types[i];
+		if (type != gc->root_type) sweep_type(type, &worker->stack);
+	}
+	return NULL;
+}
+
+void count_types_cb(void * type_refc, void * arg){
+	(*(size_t *)arg)++;
+}
+
+void list_types_cb(void * type_refc, void * arg){
+	gc_t * gc = arg;
+	type_t * type = compost_get_c_object(type_refc);
+	gc->types[gc->n_types++] = type;
+	// built now, since the workers share them
+	get_reset_plan(type);
+	if (gc->n_workers > 1) for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)){
+		prepare_marks(desc);
+	}
+}
+
+/* run_gc (private function)
+ * note: other threads must not use compost while it runs.
+ *
+ * Starts a new collection, then runs its workers: compost_gc_threads
+ * of them, the calling thread included. The types of the context are
+ * listed first: pages get their marks beforehand when several threads
+ * share them.
+ * Return value: none
+ */
+void run_gc(gc_t * gc){
+	size_t threads = compost_gc_threads ? compost_gc_threads : 1;
+	abandon_gc_step();
+	collection_epoch++;
+	gc->n_types = 0;
+	compost_for_each_type(gc->root_type, count_types_cb, &gc->n_types);
+	gc->types = malloc(gc->n_types * sizeof(type_t *));
+	gc->workers = calloc(threads, sizeof(gc_worker_t));
+	gc->next_root = gc->next_prune = gc->next_sweep = 0;
+	gc->idle = 0;
+	gc->n_workers = threads;
+	gc->n_types = 0;
+	compost_for_each_type(gc->root_type, list_types_cb, gc);
+	select_types(gc->types, gc->n_types);
+
+	pthread_mutex_init(&gc->start_lock, NULL);
+	pthread_mutex_lock(&gc->start_lock);
+	size_t started = 1;
+	for (size_t i = 0; i < threads; i++){
+		gc->workers[i].gc = gc;
+		pthread_mutex_init(&gc->workers[i].lock, NULL);
+	}
+	while (started < threads && pthread_create(&gc->workers[started].thread, NULL, (void *(*)(void *))run_gc_worker, &gc->workers[started]) == 0){
+		started++;
+	}
+	// threads which could not be created are done without
+	gc->n_workers = started;
+	pthread_barrier_init(&gc->barrier, NULL, started);
+	pthread_mutex_unlock(&gc->start_lock);
+	run_gc_worker(&gc->workers[0]);
+	for (size_t i = 1; i < started; i++) pthread_join(gc->workers[i].thread, NULL);
+
+	pthread_barrier_destroy(&gc->barrier);
+	pthread_mutex_destroy(&gc->start_lock);
+	for (size_t i = 0; i < threads; i++){
+		gc_worker_t * worker = &gc->workers[i];
+		while (worker->stack.len) sweep_deferred(worker->stack.refcs[--worker->stack.len]);
+		free(worker->stack.refcs);
+		free(worker->shared.refcs);
+		pthread_mutex_destroy(&worker->lock);
+	}
+	free(gc->workers);
+	free(gc->types);
+	// every live object is marked: the next objects are young
+	forget_young_pages();
+	young_context = get_root_page(gc->root_type);
+}
+
+/* gc_barrier (pointer raw_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Keeps an incremental collection correct while the program runs
+ * between its steps. It is called on the objects which get protected,
+ * referenced or attached (so that new objects are kept), and on those
+ * which get unprotected, unreferenced or detached (so that everything
+ * reachable when the collection started is marked). Once the mark
+ * phase is over, marking the object is enough: the objects its fields
+ * lead to went through the barrier themselves.
+ * Return value: none
+ */
+void gc_barrier(void ** raw_refc){
+	if (__atomic_load_n(&gc_cursor.phase, __ATOMIC_ACQUIRE) == GC_IDLE) return;
+	pthread_mutex_lock(&gc_barrier_lock);
+	if (gc_cursor.phase <= GC_MARK) push_mark(&gc_cursor.stack, raw_refc);
+	else mark_slot(raw_refc);
+	pthread_mutex_unlock(&gc_barrier_lock);
+}
+
+/* gc_barrier_relocate (pointer old_refc, pointer new_refc)
+ * note: this function is not meant to be used externally.
+ *
+ * Same as gc_barrier, for an object which relocate moves: the mark
+ * stack must not keep its old location, which may be unmapped.
+ * Return value: none
+ */
+void gc_barrier_relocate(void ** old_refc, void ** new_refc){
+	if (__atomic_load_n(&gc_cursor.phase, __ATOMIC_ACQUIRE) == GC_IDLE) return;
+	pthread_mutex_lock(&gc_barrier_lock);
+	for (size_t i = 0; i < gc_cursor.stack.len; i++){
+		if (gc_cursor.stack.refcs[i] == old_refc) gc_cursor.stack.refcs[i] = new_refc;
+	}
+	pthread_mutex_unlock(&gc_barrier_lock);
+	gc_barrier(new_refc);
+}
+
+void list_step_types_cb(void * type_refc, void * arg){
+	type_t * type = compost_get_c_object(type_refc);
+	gc_cursor.types[gc_cursor.n_types++] = type;
+	get_reset_plan(type);
+	for (page_desc_t * desc = type->page_list; desc; desc = PG_NEXT(desc)) prepare_marks(desc);
+}
+
+/* abandon_gc_step ()
+ * note: this function is not meant to be used externally.
+ *
+ * Forgets the incremental collection in progress, if any; the garbage
+ * collector calls this before starting a collection of its own.
+ * Return value: none
+ */
+void abandon_gc_step(){
+	if (gc_cursor.phase == GC_IDLE) return;
+	__atomic_store_n(&gc_cursor.phase, GC_IDLE, __ATOMIC_RELEASE);
+	free(gc_cursor.types);
+	free(gc_cursor.stack.refcs);
+	gc_cursor.stack = (mark_stack_t){ NULL, 0, 0 };
+}
+
+/* is_step_type_selected (private function)
+ *
+ * Tells whether the current phase of an incremental collection visits
+ * a type: the types which select_types did not select are only walked
+ * for their roots.
+ * Return value: true if the pages of the type must be visited
+ */
+bool is_step_type_selected(size_t i){
+	return gc_cursor.phase < GC_PRUNE || get_runtime(gc_cursor.types[i])->collect;
+}
+
+/* next_step_page (private function)
+ *
+ * Moves the cursor of an incremental collection to its next page,
+ * going through the types in order and skipping the whole types
+ * which the current phase does not visit.
+ * Return value: false once the last type is over
+ */
+bool next_step_page(){
+	if (*gc_cursor.link != NULL && is_step_type_selected(gc_cursor.type)){
+		gc_cursor.link = (page_desc_t **)&(*gc_cursor.link)->next;
+		if (*gc_cursor.link != NULL) return true;
+	}
+	while (++gc_cursor.type < gc_cursor.n_types){
+		if (!is_step_type_selected(gc_cursor.type)) continue;
+		gc_cursor.link = (page_desc_t **)&gc_cursor.types[gc_cursor.type]->page_list;
+		if (*gc_cursor.link != NULL) return true;
+	}
+	return false;
+}
+
+void start_step_phase(uint8_t phase){
+	gc_cursor.type = 0;
+	gc_cursor.link = (page_desc_t **)&gc_cursor.types[0]->page_list;
+	__atomic_store_n(&gc_cursor.phase, phase, __ATOMIC_RELEASE);
+}
+
+/* gc_step (root type pointer root_type, 64bit budget)
+ * note: this function is indirectly responsible for page unmaps.
+ * note: other threads must not use compost while it runs.
+ *
+ * Runs a slice of an incremental collection, starting one if none is
+ * in progress. The collection goes through the same phases as
+ * compost_garbage_collect, resuming from a cursor on the pages of the
+ * types of the context, and prunes and sweeps the same types (see
+ * select_types); the program may run between steps, barriers
+ * keeping the marks right. The budget is a number of slots visited or
+ * instances traced, and a step may go beyond it by one page or one
+ * array. Objects freed by a thread must not be protected again by
+ * another thread while a collection is in progress.
+ * Return value: true if the collection is over
+ */
+bool compost_gc_step(type_t * root_type, size_t budget){
+	if (gc_cursor.phase == GC_IDLE){
+		collection_epoch++;
+		young_context = NULL;
+		gc_cursor.root_type = root_type;
+		gc_cursor.n_types = 0;
+		compost_for_each_type(root_type, count_types_cb, &gc_cursor.n_types);
+		gc_cursor.types = malloc(gc_cursor.n_types * sizeof(type_t *));
+		gc_cursor.n_types = 0;
+		compost_for_each_type(root_type, list_step_types_cb, NULL);
+		// the root type is swept last: it resets the dead types
+		for (size_t i = 0; i + 1 < gc_cursor.n_types; i++){
+			if (gc_cursor.types[i] != root_type) continue;
+			gc_cursor.types[i] = gc_cursor.types[gc_cursor.n_types - 1];
+			gc_cursor.types[gc_cursor.n_types - 1] = root_type;
+		}
+		select_types(gc_cursor.types, gc_cursor.n_types);
+		// types dirtied during the collection are left to the next one
+		for (size_t i = 0; i < gc_cursor.n_types; i++){
+			type_runtime_t * runtime = get_runtime(gc_cursor.types[i]);
+			if (runtime->collect) runtime->dirty = false;
+		}
+		gc_cursor.detached = false;
+		start_step_phase(GC_ROOTS);
+	}
+	type_t * type = gc_cursor.types[gc_cursor.type];
+	size_t done = 0;
+	while (done < budget && gc_cursor.phase != GC_IDLE){
+		page_desc_t * desc = *gc_cursor.link;
+		switch (gc_cursor.phase){
+			case GC_ROOTS:
+				if (desc != NULL) done += push_page_roots(desc, type, &gc_cursor.stack);
+				if (!next_step_page()) start_step_phase(GC_MARK);
+				break;
+			case GC_MARK:
+				if (gc_cursor.stack.len) done += trace_object(gc_cursor.stack.refcs[--gc_cursor.stack.len], &gc_cursor.stack);
+				else start_step_phase(GC_PRUNE);
+				break;
+			case GC_PRUNE:
+				if (desc != NULL && is_step_type_selected(gc_cursor.type)) done += prune_page(desc, type);
+				if (!next_step_page()){
+					// the magazines filled so far hold unmarked slots
+					invalidate_magazines();
+					start_step_phase(GC_SWEEP);
+				}
+				break;
+			case GC_SWEEP:
+				if (desc != NULL && is_step_type_selected(gc_cursor.type)){
+					// marked instances whose counter is cleared were spotted since
+					// the collection started, and are left as they are
+					size_t live = sweep_page(desc, type, &gc_cursor.stack);
+					gc_cursor.stack.len = 0;
+					done += PG_HAS_SLOTS(desc) ? PG_SLOTS(desc) : 1;
+					if (live == 0){
+						*gc_cursor.link = PG_NEXT(desc);
+						queue_empty_page(desc);
+						gc_cursor.detached = true;
+						// the cursor already leads to the next page
+						if (*gc_cursor.link != NULL) break;
+					}
+				}
+				bool more = next_step_page();
+				if (gc_cursor.detached && (!more || gc_cursor.types[gc_cursor.type] != type)){
+					rebuild_free_pages(type);
+					gc_cursor.detached = false;
+				}
+				if (!more){
+					forget_young_pages();
+					young_context = get_root_page(gc_cursor.root_type);
+					release_empty_pages();
+					abandon_gc_step();
+				}
+				break;
+		}
+		if (gc_cursor.phase != GC_IDLE) type = gc_cursor.types[gc_cursor.type];
+	}
+	if (gc_cursor.detached){
+		// the program must not spot slots in the detached pages
+		rebuild_free_pages(type);
+		gc_cursor.detached = false;
+	}
+	return gc_cursor.phase == GC_IDLE;
+}
+
+/* mutator_enter ()
+ *
+ * While a background collector runs, the threads using compost must
+ * call this before using it, and compost_mutator_leave once done: the
+ * collector stops the world for each of its slices, which only run
+ * while no thread is in between.
+ * Return value: none
+ */
+void compost_mutator_enter(){
+	pthread_rwlock_rdlock(&gc_world_lock);
+}
+
+void compost_mutator_leave(){
+	pthread_rwlock_unlock(&gc_world_lock);
+}
+
+void * run_collector(void * arg){
+	while (__atomic_load_n(&gc_collector.running, __ATOMIC_ACQUIRE)){
+		pthread_rwlock_wrlock(&gc_world_lock);
+		bool over = compost_gc_step(gc_collector.root_type, gc_collector.budget);
+		pthread_rwlock_unlock(&gc_world_lock);
+		if (over) usleep(gc_collector.pause_us);
+		else sched_yield();
+	}
+	return NULL;
+}
+
+/* start_collector (root type pointer root_type, 64bit budget, 64bit pause_us)
+ *
+ * Starts a thread which collects the context in the background, and
+ * waits pause_us microseconds between two collections. This is an
+ * incremental stop-the-world collector: every compost_gc_step slice of
+ * budget slots, marking and sweeping included, runs while all the
+ * mutators are stopped (see compost_mutator_enter). The mutators only
+ * run between slices, the barriers of compost_gc_step keeping the marks
+ * right meanwhile, so a pause lasts one slice, not one collection.
+ * Return value: false if the collector is already running or the thread
+ * could not be created
+ */
+bool compost_start_collector(type_t * root_type, size_t budget, size_t pause_us){
+	if (gc_collector.running) return false;
+	gc_collector.root_type = root_type;
+	gc_collector.budget = budget ? budget : 1;
+	gc_collector.pause_us = pause_us;
+	gc_collector.running = true;
+	if (pthread_create(&gc_collector.thread, NULL, run_collector, NULL) != 0){
+		gc_collector.running = false;
+		return false;
+	}
+	return true;
+}
+
+/* stop_collector ()
+ * note: the calling thread must not be between compost_mutator_enter and leave.
+ *
+ * Stops the background collector, abandoning the collection in progress.
+ * Return value: none
+ */
+void compost_stop_collector(){
+	if (!gc_collector.running) return;
+	__atomic_store_n(&gc_collector.running, false, __ATOMIC_RELEASE);
+	pthread_join(gc_collector.thread, NULL);
+	pthread_rwlock_wrlock(&gc_world_lock);
+	abandon_gc_step();
+	pthread_rwlock_unlock(&gc_world_lock);
+}
+
 /* remove_superfluous_pages (type_t pointer type)
  * note: this function is indirectly responsible for page unmaps.
+ * note: other threads must not use compost while it runs.
  *
  * Updates the page-list of a type, effectively removing
  * the empty pages (i.e. containing no referenced instances).
+ * The whole context is marked, since any object may refer to
+ * the instances of the type.
  * Return value: none
  */
 void compost_remove_superfluous_pages(type_t * type, bool should_delete){
-	type->page_list = update_page_list(type->page_list, type, should_delete);
+	gc_t gc = { .root_type = &get_root_page(type)->rt, .sweep = false };
+	run_gc(&gc);
+	if (get_runtime(type)->collect){
+		get_runtime(type)->dirty = false;
+		type->page_list = update_page_list(type->page_list, type, should_delete, NULL);
+	}
+	invalidate_magazines();
+	if (should_delete){
+		release_empty_pages();
+		rebuild_free_pages(type);
+	}
+}
+
+void rebuild_free_pages_cb(void * type_refc, void * arg){
+	rebuild_free_pages(compost_get_c_object(type_refc));
 }
 
 /* garbage_collect (root type pointer root_type)
  * note: this function is indirectly responsible for page unmaps.
+ * note: other threads must not use compost while it runs.
  *
- * Runs through all types registered in the root types page,
- * and calls remove_superfluous_pages on them if they have the TYPE_HAS_UNREF flag.
+ * Marks the objects reachable from the protected ones, detaches the
+ * dead referrers of the live ones, then sweeps the types registered in
+ * the root types page; types which may not have lost any instance since
+ * they were last swept are neither pruned nor swept (see select_types).
+ * These phases are split among compost_gc_threads threads. The cost
+ * grows with the number of slots, never with the length of the
+ * reference chains.
  * Return value: none
  */
 void compost_garbage_collect(type_t * root_type){
-	/*
-	 * TODO : pre-run to subtract independent-references that
-	 * are unreferenced themselves
-	 */
-	page_desc_t * desc, * desc_bck = root_type->page_list;
-	for (size_t i = 0; i < 2; i++){
-		desc = desc_bck;
-		while (desc){
-			size_t pg_limit = PG_LIMIT(desc, root_type);
-			for (void * refc = PG_REFC2(desc); PP(refc).s < pg_limit; refc += root_type->paged_size){
-				if (*(void **)refc == NULL) continue;
-				compost_remove_superfluous_pages(compost_get_c_object(refc), i > 0);
-			}
-			desc = PG_NEXT(desc);
+	gc_t gc = { .root_type = root_type, .sweep = true };
+	run_gc(&gc);
+	sweep_type(root_type, NULL);
+	// pages are only unmapped once every type has been updated
+	release_empty_pages();
+	invalidate_magazines();
+	compost_for_each_type(root_type, rebuild_free_pages_cb, NULL);
+}
+
+/* minor_collect (root type pointer root_type)
+ * note: other threads must not use compost while it runs.
+ *
+ * Collects the young objects of a context, i.e. the ones spotted since
+ * the last complete collection (compost_garbage_collect, or the last
+ * step of compost_gc_step), whose marks are kept to tell the old objects
+ * apart; objects are never moved. Only the pages listed by touch_page are
+ * visited: their protected young objects and every live old object
+ * they hold are the roots. Young survivors get marked, which makes
+ * them old; dead old objects wait for the next complete collection,
+ * which runs instead of this one when the marks are stale or belong
+ * to another context. No page is released.
+ * Return value: none
+ */
+void compost_minor_collect(type_t * root_type){
+	if (gc_cursor.phase != GC_IDLE || young_context != get_root_page(root_type)){
+		return compost_garbage_collect(root_type);
+	}
+	mark_stack_t stack = { NULL, 0, 0 };
+	for (page_desc_t * desc = young_pages; desc; desc = (page_desc_t *)desc->next_young.p){
+		type_t * type = strip_variant(PG_TYPE2(desc));
+		if (get_root_page(type) != young_context) continue;
+		size_t pg_limit = PG_LIMIT(desc, type);
+		for (void ** refc = PG_REFC2(desc); refc && PP(refc).s < pg_limit; refc = next_slot(type, refc)){
+			if (is_slot_alive(refc)) trace_object(refc, &stack);
+			else if (*refc == FAKE_DEPENDENT(refc)) push_mark(&stack, refc);
 		}
 	}
-}
\ No newline at end of file
+	while (stack.len) trace_object(stack.refcs[--stack.len], &stack);
+	free(stack.refcs);
+
+	// the root type resets the dead types: left to compost_garbage_collect
+	for (page_desc_t * desc = young_pages; desc; desc = (page_desc_t *)desc->next_young.p){
+		type_t * type = strip_variant(PG_TYPE2(desc));
+		if (type != root_type && get_root_page(type) == young_context) unlink_dead_page(desc, type);
+	}
+	for (page_desc_t * desc = young_pages; desc; desc = (page_desc_t *)desc->next_young.p){
+		type_t * type = strip_variant(PG_TYPE2(desc));
+		if (type != root_type && get_root_page(type) == young_context) sweep_page(desc, type, NULL);
+	}
+	forget_young_pages();
+	invalidate_magazines();
+}
@@ -87,8 +87,8 @@ typedef COMPOST_STRUCT array_page {
 	// FIB
 
 	// root type
-	array_obj_t rt_fib_ap; // size = 81
-#define rt_sz ((PTRSZ * 10) + 1)
+	array_obj_t rt_fib_ap; // size = 89
+#define rt_sz ((PTRSZ * 11) + 1)
 
 	fib_o_t rt_dfia [PTRSZ]; // dfia
 	fib_o_t rt_dfib [PTRSZ]; // dfib
@@ -102,6 +102,7 @@ typedef COMPOST_STRUCT array_page {
 	fib_o_t rt_statf[PTRSZ]; // static_fields
 
 	fib_o_t rt_pgl  [PTRSZ]; // page_list
+	fib_o_t rt_rtm  [PTRSZ]; // runtime
 	fib_o_t rt_cdat [PTRSZ]; // client_data
 
 	fib_o_t rt_flags[1]; // flags
@@ -211,6 +212,8 @@ typedef COMPOST_STRUCT dict_header_page {
 } dict_header_page_t;
 
 context_t compost_setup(){
+	setup_page_unit();
+	if (compost_heap_reserve) reserve_heap();
 	compost_pages = 3;
 	root_page_t        * rp  = (root_page_t        *)new_random_page(compost_pages).p;
 	array_page_t       * arp = (array_page_t       *)(PP(rp).s  + page_size);
@@ -234,7 +237,7 @@ context_t compost_setup(){
 			rt_sz, 1, // own offset--------------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->rt.df_refc, &dhp->rt.sf_refc,
-			rp, NULL,
+			rp, NULL, NULL,
 			TYPE_INTERNAL | TYPE_ROOT
 		};
 		rp->rt.paged_size = compute_paged_size((&rp->rt));
@@ -248,7 +251,7 @@ context_t compost_setup(){
 			PTRSZ, 0, // own offsets -------------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->szt.df_refc, &dhp->szt.sf_refc,
-			NULL, NULL, // no pages
+			NULL, NULL, NULL, // no pages
 			TYPE_PRIMITIVE | TYPE_INTERNAL
 		};
 		rp->szt.paged_size = compute_paged_size((&rp->szt));
@@ -260,7 +263,7 @@ context_t compost_setup(){
 			sizeof(uint8_t), 0, // own offsets -------------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->chrt.df_refc, &dhp->chrt.sf_refc,
-			NULL, NULL, // no pages
+			NULL, NULL, NULL, // no pages
 			TYPE_PRIMITIVE | TYPE_INTERNAL | TYPE_CHAR
 		};
 		rp->chrt.paged_size = compute_paged_size((&rp->chrt));
@@ -272,7 +275,7 @@ context_t compost_setup(){
 			fiat_sz, 1, // own offset--------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->fiat.df_refc, &dhp->fiat.sf_refc,
-			NULL, NULL,
+			NULL, NULL, NULL,
 			TYPE_INTERNAL
 		};
 		rp->fiat.paged_size = compute_paged_size((&rp->fiat));
@@ -284,7 +287,7 @@ context_t compost_setup(){
 			fibt_sz, 1, // own offset--------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->fibt.df_refc, &dhp->fibt.sf_refc,
-			NULL, NULL,
+			NULL, NULL, NULL,
 			TYPE_INTERNAL | TYPE_FIB
 		};
 		rp->fibt.paged_size = compute_paged_size((&rp->fibt));
@@ -296,7 +299,7 @@ context_t compost_setup(){
 			dht_sz, 1, // own offset---------------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->dht.df_refc, &dhp->dht.sf_refc,
-			dhp, NULL,
+			dhp, NULL, NULL,
 			TYPE_INTERNAL
 		};
 		rp->dht.paged_size = compute_paged_size((&rp->dht));
@@ -310,7 +313,7 @@ context_t compost_setup(){
 			dbt_sz, 1, // own offset---------------------- TO WATCH
 			0, NULL, // computations later done
 			&dhp->dbt.df_refc, &dhp->dbt.sf_refc,
-			NULL, NULL, // no page yet
+			NULL, NULL, NULL, // no page yet
 			TYPE_INTERNAL
 		};
 		rp->dbt.paged_size = compute_paged_size((&rp->dbt));
@@ -322,7 +325,7 @@ context_t compost_setup(){
 			art_sz, 1, // own offset---------------------- TO WATCH
 			0, &arp->var_fia_ap, // computations later done
 			&dhp->art.df_refc, &dhp->art.sf_refc,
-			arp, NULL, // no page yet
+			arp, NULL, NULL, // no page yet
 			TYPE_INTERNAL | TYPE_ARRAY
 		};
 		rp->art.paged_size = compute_paged_size((&rp->art));
@@ -360,6 +363,7 @@ context_t compost_setup(){
 		arp->rt_dynf [0].fib = (field_info_b_t){ { .type = &rp->dht }, FIBF_DEPENDENT };
 		arp->rt_statf[0].fib = (field_info_b_t){ { .type = &rp->dht }, FIBF_DEPENDENT };
 		arp->rt_pgl  [0].fib = (field_info_b_t){ { .type = &rp->szt }, FIBF_BASIC };
+		arp->rt_rtm  [0].fib = (field_info_b_t){ { .type = &rp->szt }, FIBF_BASIC }; // see free_runtime
 		arp->rt_cdat [0].fib = (field_info_b_t){ { .type = NULL }, FIBF_BASIC }; // set by the client
 		arp->rt_flags[0].fib = (field_info_b_t){ { .type = &rp->chrt }, FIBF_BASIC };
 
@@ -372,6 +376,7 @@ context_t compost_setup(){
 		for (int i = 1; i < PTRSZ; i++) arp->rt_dynf [i].fib = goback;
 		for (int i = 1; i < PTRSZ; i++) arp->rt_statf[i].fib = goback;
 		for (int i = 1; i < PTRSZ; i++) arp->rt_pgl  [i].fib = goback;
+		for (int i = 1; i < PTRSZ; i++) arp->rt_rtm  [i].fib = goback;
 		for (int i = 1; i < PTRSZ; i++) arp->rt_cdat [i].fib = goback;
 		// rt_flags is only 1 byte
 
@@ -503,6 +508,15 @@ context_t compost_setup(){
 		dhp->art.sf = (dict_t){ NULL, NULL };
 	}
 
+	// OCCUPANCY BITMAPS
+	if (true){
+		prepare_page_slots(&rp->header, rp->rt.paged_size);
+		claim_used_slots(&rp->header);
+
+		prepare_page_slots(&dhp->header, rp->dht.paged_size);
+		claim_used_slots(&dhp->header);
+	}
+
 	// FIB INIT
 	if (true){
 		// offset = fib + type.offsets